@@ -7,25 +7,215 @@
  */
 
 // Includes
+#define _GNU_SOURCE                 // pipe2, memfd_create, CLONE_PARENT
+#include<dirent.h>          // opendir, readdir
+#include<errno.h>           // errno
 #include<fcntl.h>           // open
-#include<math.h>            // floor, log10
+#include<limits.h>          // PIPE_BUF
+#include<poll.h>            // poll
+#include<sched.h>           // CLONE_PARENT
 #include<signal.h>          // sigset_t
 #include<stdbool.h>         // bool
 #include<stdio.h>           // printf, getchar
 #include<stdlib.h>          // NULL, EXIT_SUCCESS, size_t, malloc
 #include<string.h>          // strlen, strcpy, strcmp
+#include<sys/inotify.h>     // inotify_init1
+#include<sys/mman.h>        // memfd_create
+#include<sys/resource.h>    // setrlimit
+#include<sys/socket.h>      // socketpair, sendmsg, recvmsg
+#include<sys/stat.h>        // stat
+#include<sys/syscall.h>     // SYS_clone
 #include<sys/types.h>       // pid
-#include<sys/wait.h>        // waitpid
+#include<sys/wait.h>        // waitpid, wait4
+#include<termios.h>         // tcsetattr
+#include<time.h>            // clock_gettime
 #include<unistd.h>          // chdir
 
 // Defines
 #define LINE_LENGTH     2048
 #define MAX_ARGUMENTS   512
+#define BENCH_TIME      500000
+#define TRACE_BUFFER    65536
+#define TRACE_EVENT     256
+#define TRACE_DEFAULT   "smallsh-trace.json"
+#define KILL_GRACE      2000
+#define LIMIT_COUNT     7
+#define CPU_SLACK       100000
+#define HISTORY_LENGTH  1000
+#define COMPLETION_LIST 100
+#define KEY_DELETE      256
+#define HERE_BUFFER     65536
+#define WATCH_DEBOUNCE  100
+
+// Structs
+/* traceLog ******************************************************************\
+ * TraceLog holds trace events (Chrome trace-event JSON) until they are
+ *  written to the trace file in one large write.
+ * Data Members:
+ *  fd (int): Trace file descriptor (-1 when tracing is off)
+ *  path (char *): Filepath of last trace file
+ *  buffer (char[]): Events not yet written
+ *  length (size_t): Bytes used in `buffer`
+ *  empty (bool): Whether no event has been added to the file yet
+ *****************************************************************************/
+struct traceLog
+{
+    int fd;
+    char *path;
+    char buffer[TRACE_BUFFER];
+    size_t length;
+    bool empty;
+};
+
+/* limitName *****************************************************************\
+ * LimitName connects a name used by `ulimit` and `limit` to a resource.
+ * Data Members:
+ *  name (char *): Name of limit, as typed (`mem`, `cpu`, ...)
+ *  resource (int): Resource number for `setrlimit`
+ *  unit (char): `b` for bytes, `s` for seconds, `n` for a plain count
+ *****************************************************************************/
+struct limitName
+{
+    char *name;
+    int resource;
+    char unit;
+};
+
+/* limits ********************************************************************\
+ * Limits represents a set of resource limits to apply to a child process.
+ *  Entries line up with the `limitNames` table.
+ * Data Members:
+ *  set (bool[]): Whether each limit was given
+ *  value (rlim_t[]): Value of each limit that was given
+ *****************************************************************************/
+struct limits
+{
+    bool set[LIMIT_COUNT];
+    rlim_t value[LIMIT_COUNT];
+};
+
+/* spawnRequest **************************************************************\
+ * SpawnRequest is the fixed part of a request to the spawn helper.  It is
+ *  followed by strings, each ending in `\0`: the arguments, then the
+ *  environment.  Descriptors go along with it: the working directory, then
+ *  any new input, output and error, then any trace pipe.
+ * Data Members:
+ *  background (bool): Whether command goes to the background
+ *  limits (struct limits): Resource limits for the command
+ *  argCount (int): Number of arguments
+ *  envCount (int): Number of environment strings
+ *  redirected (bool[]): Whether a descriptor is included for input, output
+ *      and error
+ *  traced (bool): Whether a trace pipe descriptor is included
+ *****************************************************************************/
+struct spawnRequest
+{
+    bool background;
+    struct limits limits;
+    int argCount;
+    int envCount;
+    bool redirected[3];
+    bool traced;
+};
+
+/* trieNode ******************************************************************\
+ * TrieNode represents one character of the command names on PATH.  Nodes
+ *  that share a prefix share a path from the root.
+ * Data Members:
+ *  c (char): Character at this node
+ *  dirs (unsigned long long): Bit set for each PATH directory holding a
+ *      command that ends here (0 if no command ends here)
+ *  child (struct trieNode *): First node of the next character
+ *  sibling (struct trieNode *): Next node at this character (sorted by `c`)
+ *****************************************************************************/
+struct trieNode
+{
+    char c;
+    unsigned long long dirs;
+    struct trieNode *child;
+    struct trieNode *sibling;
+};
+
+/* pathIndex *****************************************************************\
+ * PathIndex keeps the trie of commands on PATH, and what is needed to tell
+ *  when it is out of date.
+ * Data Members:
+ *  path (char *): Value of PATH when the trie was built
+ *  dirs (char **): Directories in PATH
+ *  mtimes (struct timespec *): Modification time of each directory when it
+ *      was last scanned
+ *  dirCount (int): Number of directories in PATH
+ *  root (struct trieNode *): First node of the trie
+ *****************************************************************************/
+struct pathIndex
+{
+    char *path;
+    char **dirs;
+    struct timespec *mtimes;
+    int dirCount;
+    struct trieNode *root;
+};
+
+/* completion ****************************************************************\
+ * Completion holds the matches for a word being completed.
+ * Data Members:
+ *  common (char[]): Text that every match starts with
+ *  names (char *[]): First COMPLETION_LIST matches, for listing
+ *  count (int): Number of matches
+ *  directory (bool): Whether the last match is a directory
+ *****************************************************************************/
+struct completion
+{
+    char common[LINE_LENGTH];
+    char *names[COMPLETION_LIST];
+    int count;
+    bool directory;
+};
+
+/* lineHistory ***************************************************************\
+ * LineHistory holds the lines entered at the line editor, oldest first.
+ * Data Members:
+ *  lines (char *[]): Lines entered
+ *  count (int): Number of lines held
+ *****************************************************************************/
+struct lineHistory
+{
+    char *lines[HISTORY_LENGTH];
+    int count;
+};
+
+/* watchedPath ***************************************************************\
+ * WatchedPath represents one path the `watch` built-in command is watching.
+ * Data Members:
+ *  wd (int): inotify watch descriptor (of the path's directory, for files)
+ *  name (char *): File name within the directory, or NULL for a directory
+ *****************************************************************************/
+struct watchedPath
+{
+    int wd;
+    char *name;
+};
 
 // Global Variables
 bool backgroundOnly = false;
+volatile sig_atomic_t watchInterrupted = 0;  // SIGINT during `watch`
+int lineNumber = 0;                         // lines read so far
+int killGrace = KILL_GRACE;                 // ms before `exit` uses SIGKILL
+int spawnHelper = -1;                       // socket to spawn helper, or -1
+struct traceLog trace = { .fd = -1 };
+struct limits shellLimits;                  // set by `ulimit`
+struct pathIndex commands;                  // commands for Tab completion
+struct lineHistory history;                 // lines for Up/Down recall
+struct limitName limitNames[LIMIT_COUNT] = {
+    {"cpu", RLIMIT_CPU, 's'},
+    {"mem", RLIMIT_AS, 'b'},
+    {"fsize", RLIMIT_FSIZE, 'b'},
+    {"nofile", RLIMIT_NOFILE, 'n'},
+    {"nproc", RLIMIT_NPROC, 'n'},
+    {"stack", RLIMIT_STACK, 'b'},
+    {"core", RLIMIT_CORE, 'b'}
+};
 
-// Structs
 /* argument ******************************************************************\
  * Argument represents a single argument (word) in smallsh input
  * Data Members:
@@ -33,8 +223,28 @@ bool backgroundOnly = false;
  *  position (int): location within linked list
  *  redirInput (char *): any input redirection filepath (placed in head only)
  *  redirOutput (char *): any output redirection filepath (placed in head only)
+ *  appendOutput (bool): whether output is appended to `redirOutput` (placed
+ *      in head only)
+ *  redirError (char *): any error redirection filepath (placed in head only)
+ *  appendError (bool): whether errors are appended to `redirError` (placed
+ *      in head only)
+ *  errorToOutput (bool): whether errors go wherever output goes (placed in
+ *      head only)
  *  background (bool): whether command should go to background (placed in head
  *      only)
+ *  line (int): line number of input the command came from (placed in head
+ *      only)
+ *  limits (struct limits *): any resource limits from a `limit` prefix
+ *      (placed in head only)
+ *  hereFD (int): descriptor holding any here-string or here-document, -1 if
+ *      none (placed in head only)
+ *  hereDelim (char *): any here-document delimiter still to be read up to
+ *      (placed in head only)
+ *  connector (char): how the list goes on after this command: `;` always,
+ *      `&` (`&&`) if it succeeded, `|` (`||`) if it failed, or `\0` at the
+ *      end of the list (placed in head only)
+ *  nextCommand (struct argument *): head of next command in the list, if
+ *      any (placed in head only)
  *  next (struct argument *): used to make a linked list of arguments
  *****************************************************************************/
 struct argument
@@ -43,7 +253,17 @@ struct argument
     int position;
     char *redirInput;
     char *redirOutput;
+    bool appendOutput;
+    char *redirError;
+    bool appendError;
+    bool errorToOutput;
     bool background;
+    int line;
+    struct limits *limits;
+    int hereFD;
+    char *hereDelim;
+    char connector;
+    struct argument *nextCommand;
     struct argument *next;
 };
 
@@ -51,11 +271,15 @@ struct argument
  * ChildProc represents a child process.
  * Data Members:
  *  id (int): <pid> of child
+ *  line (int): Line number of input the child was started from
+ *  start (long long): Time the child was started, in microseconds
  *  next (struct childProc *): Location of next childProc
  * ***************************************************************************/
 struct childProc
 {
     int id;
+    int line;
+    long long start;
     struct childProc *next;
 };
 
@@ -65,38 +289,251 @@ struct childProc
  * Data Members:
  *  exit (bool):  Whether the last task ended as an `exit` or not.
  *  num (int): Exit or termination number.
+ *  limit (char *): Name of resource limit that ended the task, or NULL
  *****************************************************************************/
 struct endStatus
 {
     bool exit;
     int num;
+    char *limit;
+};
+
+/* scriptLine ****************************************************************\
+ * ScriptLine represents one line of a script run in parallel (`-P`) mode.
+ * Data Members:
+ *  number (int): Line number within the script (starting at 1)
+ *  head (struct argument *): Parsed words of line (NULL if blank or comment)
+ *  barrier (bool): Whether line waits for all earlier lines, and all later
+ *      lines wait for it (`wait` and the built-in commands)
+ *  deps (int): Number of unfinished lines this line is waiting on
+ *  dependents (int *): Indexes of the lines waiting on this line
+ *  dependentCount (int): Number of entries in `dependents`
+ *  pid (pid_t): <pid> of line's process while running, -1 otherwise
+ *  start (long long): Time line's process was started, in microseconds
+ *  done (bool): Whether line has finished
+ *  result (struct endStatus): How the line finished
+ *****************************************************************************/
+struct scriptLine
+{
+    int number;
+    struct argument *head;
+    bool barrier;
+    int deps;
+    int *dependents;
+    int dependentCount;
+    pid_t pid;
+    long long start;
+    bool done;
+    struct endStatus result;
 };
 
 
 // Function Prototypes
+long long traceTime(void);
+void traceFlush(void);
+void traceEvent(char *, pid_t, int, long long, long long);
+bool traceStart(char *);
+void traceStop(void);
 void handle_SIGTSTP(int);
+int signalChildren(struct childProc *, int);
+void killChildren(struct childProc *);
 void freeChildren(struct childProc *);
 void freeArguments(struct argument *);
 struct childProc *removeChildProc(struct childProc *, int );
-struct childProc *createChildProc(struct childProc *, int );
-void setOuput(struct argument *);
-void setInput(struct argument *);
+struct childProc *createChildProc(struct childProc *, int, int);
+bool openRedirect(char *, int, int *);
+bool openRedirects(struct argument *, int[]);
+void setRedirects(int[]);
+void closeRedirects(int[]);
+int hereDocument(char *, size_t);
+bool readHereDocument(FILE *, struct argument *, pid_t);
+void replaceText(char **, char *);
 bool redirectIO(struct argument *);
 void setBackground(struct argument *);
 void createProcessArguments(char *[], struct argument *);
+bool parseLimit(char *, struct limits *);
+void applyLimits(struct limits *);
+void printLimits(struct limits *);
+struct argument *setLimits(struct argument *);
+void setEndStatus(struct endStatus *, int, struct rusage *,
+        struct argument *);
+void execChild(struct argument *, struct limits *, char *[], int[],
+        struct sigaction, struct sigaction);
+bool startSpawnHelper(void);
+void runSpawnHelper(int);
+pid_t requestSpawn(struct argument *, struct limits *, int[], int);
+pid_t spawnProcess(struct argument *, struct sigaction, struct sigaction);
 struct childProc *otherProcess(struct argument *, struct childProc *,
         struct endStatus *, struct sigaction, struct sigaction);
 void printStatus(struct endStatus *);
-void changeDir(struct argument *);
-bool builtIn(struct argument *, struct childProc *, struct endStatus *);
+bool changeDir(struct argument *);
+bool builtIn(struct argument *, struct childProc *, struct endStatus *,
+        struct endStatus *);
+struct childProc *runCommand(struct argument *, struct childProc *,
+        struct endStatus *, struct endStatus *, struct sigaction,
+        struct sigaction);
+struct childProc *runList(struct argument *, struct childProc *,
+        struct endStatus *, struct endStatus *, struct sigaction,
+        struct sigaction);
+pid_t spawnList(struct argument *, struct sigaction, struct sigaction);
 struct argument *makeArgument(char *);
+char *nextWord(char **, bool);
+char listConnector(char *);
+struct argument *parseCommand(struct argument *);
 struct argument *separateInput(char *);
-int check$$(char *, int, pid_t);
-struct argument *getInput(pid_t);
+void trieInsert(struct trieNode **, char *, unsigned long long);
+void trieClear(struct trieNode **, unsigned long long);
+void trieCollect(struct trieNode *, char *, int, struct completion *);
+void scanPathDir(int);
+void indexPath(void);
+void addCompletion(struct completion *, char *, bool);
+void completeCommand(char *, struct completion *);
+char *completeFile(char *, struct completion *);
+void refreshLine(char *, char *, int);
+void completeLine(char *, char *, int *, bool);
+void addHistory(char *);
+bool editLine(char *, char *);
+bool readLine(FILE *, char *, char *);
+int check$$(char *, int *, char *, int, pid_t);
+int expandInput(char *, char *, pid_t);
+struct argument *parseLine(char *, pid_t);
+struct argument *getInput(FILE *, pid_t, bool *);
 struct childProc *checkTerminatedChildren(struct childProc *, bool);
-int main(void);
+struct childProc *waitChildren(struct childProc *);
+void handle_SIGINT_watch(int);
+bool addWatch(int, char *, struct watchedPath *);
+bool readWatchEvents(int, struct watchedPath *, int, char *[]);
+struct childProc *watchCommand(struct argument *, struct childProc *,
+        struct endStatus *, struct endStatus *, struct sigaction,
+        struct sigaction);
+struct scriptLine *readScript(FILE *, pid_t, int *);
+bool commandsConflict(struct argument *, struct argument *);
+bool linesConflict(struct argument *, struct argument *);
+void addDependency(struct scriptLine *, int, int);
+void buildDependencies(struct scriptLine *, int);
+void finishLine(struct scriptLine *, int);
+void freeScript(struct scriptLine *, int);
+int runScriptParallel(char *, pid_t, struct endStatus *, struct sigaction,
+        struct sigaction);
+void benchCase(char *, char *);
+int benchParse(void);
+int main(int, char *[]);
 
 // Functions
+/* traceTime *****************************************************************\
+ * TraceTime gives the current time for trace events.
+ * Accepts:
+ *  Nothing
+ * Returns:
+ *  Monotonic time in microseconds (long long)
+ *****************************************************************************/
+long long traceTime(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (long long)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+/* traceFlush ****************************************************************\
+ * TraceFlush writes the buffered trace events to the trace file.
+ * Accepts:
+ *  Nothing
+ * Returns:
+ *  Nothing
+ *****************************************************************************/
+void traceFlush(void)
+{
+    size_t written = 0;
+    while (written < trace.length)
+    {
+        ssize_t result = write(trace.fd, trace.buffer + written,
+                trace.length - written);
+        if (result == -1)
+        {
+            perror("Cannot write trace file");
+            break;
+        }
+        written += result;
+    }
+    trace.length = 0;
+    return;
+}
+
+/* traceEvent ****************************************************************\
+ * TraceEvent adds a complete ("X") event to the trace buffer, if tracing is
+ *  on.  Events are drawn on the track of the process they describe.
+ * Accepts:
+ *  name (char *): Name of span (`parse`, `spawn`, `exec`, ...)
+ *  id (pid_t): <pid> the span belongs to
+ *  line (int): Line number of input the span belongs to
+ *  start (long long): Start of span, from `traceTime`
+ *  end (long long): End of span, from `traceTime`
+ * Returns:
+ *  Nothing
+ *****************************************************************************/
+void traceEvent(char *name, pid_t id, int line, long long start,
+        long long end)
+{
+    if (trace.fd == -1)
+        return;
+    if (trace.length + TRACE_EVENT > TRACE_BUFFER)
+        traceFlush();
+
+    trace.length += snprintf(trace.buffer + trace.length, TRACE_EVENT,
+            "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":%d,\"tid\":%d,"
+            "\"ts\":%lld,\"dur\":%lld,\"args\":{\"pid\":%d,\"line\":%d}}",
+            trace.empty ? "\n" : ",\n", name, getpid(), id, start,
+            end - start, id, line);
+    trace.empty = false;
+    return;
+}
+
+/* traceStart ****************************************************************\
+ * TraceStart turns tracing on, writing events to a new trace file.
+ * Accepts:
+ *  path (char *): Filepath of trace file
+ * Returns:
+ *  True if tracing is now on.  False, otherwise.
+ *****************************************************************************/
+bool traceStart(char *path)
+{
+    traceStop();
+    trace.fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+    if (trace.fd == -1)
+    {
+        perror(path);
+        return false;
+    }
+    if (path != trace.path)
+    {
+        free(trace.path);
+        trace.path = calloc(strlen(path) + 1, sizeof(char));
+        strcpy(trace.path, path);
+    }
+    trace.length = snprintf(trace.buffer, TRACE_BUFFER, "[");
+    trace.empty = true;
+    return true;
+}
+
+/* traceStop *****************************************************************\
+ * TraceStop turns tracing off, finishing and closing the trace file.
+ * Accepts:
+ *  Nothing
+ * Returns:
+ *  Nothing
+ *****************************************************************************/
+void traceStop(void)
+{
+    if (trace.fd == -1)
+        return;
+    trace.length += snprintf(trace.buffer + trace.length,
+            TRACE_BUFFER - trace.length, "\n]\n");
+    traceFlush();
+    close(trace.fd);
+    trace.fd = -1;
+    return;
+}
+
 /* handle_SIGTSTP_children ***************************************************\
  * Handle_SIGTSTP_Children takes SIGTSTP and passes it to parent.
  * Accepts:
@@ -174,6 +611,12 @@ void freeArguments(struct argument *head)
         free(prevArg->text);
         free(prevArg->redirInput);
         free(prevArg->redirOutput);
+        free(prevArg->redirError);
+        free(prevArg->limits);
+        free(prevArg->hereDelim);
+        if (prevArg->hereFD != -1)
+            close(prevArg->hereFD);
+        freeArguments(prevArg->nextCommand);
         free(prevArg);
     }
     free(currentArg);
@@ -228,14 +671,17 @@ struct childProc *removeChildProc(struct childProc *head, int id)
  * Accepts:
  *  head (struct childProc *): Location of head of childProc linked list
  *  id (int): pid of childProc being created
+ *  line (int): line number of input the childProc was started from
  * Returns:
  *  head of linked list of childProcs 
  *****************************************************************************/
-struct childProc *createChildProc(struct childProc *head, int id)
+struct childProc *createChildProc(struct childProc *head, int id, int line)
 {
     struct childProc *thisChild = malloc(sizeof(struct childProc));
     thisChild->next = NULL;
     thisChild->id = id;
+    thisChild->line = line;
+    thisChild->start = traceTime();
     
     // Empty linked list of childProcs
     if (head == NULL)
@@ -256,132 +702,354 @@ struct childProc *createChildProc(struct childProc *head, int id)
 }
 
 
-/* setOutput *****************************************************************\
- * SetOutput takes information from the head of the linked list of words, and 
- *  sets output accordingly (from file, or from `/dev/null` if background
- *  without file specification).
+/* openRedirect **************************************************************\
+ * OpenRedirect opens one file a command's input, output or errors are
+ *  redirected to, reporting any error.
+ * Accepts:
+ *  path (char *): Filepath to open
+ *  flags (int): Flags for `open` (close-on-exec is added)
+ *  fd (int *): Location to store the new descriptor
+ * Returns:
+ *  True if the file was opened.  False, otherwise.
+ *****************************************************************************/
+bool openRedirect(char *path, int flags, int *fd)
+{
+    *fd = open(path, flags | O_CLOEXEC, 0666);
+    if (*fd == -1)
+    {
+        perror(path);
+        return false;
+    }
+    return true;
+}
+
+/* openRedirects *************************************************************\
+ * OpenRedirects opens the descriptors for a command's redirected input,
+ *  output and errors, in the shell, so an error is reported before anything
+ *  is started.  Input comes from a here-string or here-document, from a
+ *  file, or from `/dev/null` if background without file specification;
+ *  output goes to a file (appended with `>>`, so writes from several
+ *  commands do not overwrite each other), or to `/dev/null` if background
+ *  without file specification; errors go to a file, or wherever output goes
+ *  with `2>&1` or `&>`.
  * Accepts:
  *  head (struct argument *): Location of head of linked list of words
+ *  fds (int[]): Location to store descriptors for input, output and errors
+ *      (-1 for each left as it is)
+ * Returns:
+ *  True if every redirection was opened.  False, with none left open,
+ *      otherwise.
+ *****************************************************************************/
+bool openRedirects(struct argument *head, int fds[])
+{
+    bool opened = true;
+    fds[0] = fds[1] = fds[2] = -1;
+
+    // Here-strings and here-documents are already in a descriptor, which is
+    //  rewound in case the command is run again
+    if (head->hereFD != -1)
+    {
+        lseek(head->hereFD, 0, SEEK_SET);
+        fds[0] = fcntl(head->hereFD, F_DUPFD_CLOEXEC, 3);
+        opened = fds[0] != -1;
+    }
+    else if (head->redirInput)
+        opened = openRedirect(head->redirInput, O_RDONLY, &fds[0]);
+    else if (head->background)
+        opened = openRedirect("/dev/null", O_RDONLY, &fds[0]);
+
+    if (opened && head->redirOutput)
+        opened = openRedirect(head->redirOutput, O_WRONLY | O_CREAT
+                | (head->appendOutput ? O_APPEND : O_TRUNC), &fds[1]);
+    else if (opened && head->background)
+        opened = openRedirect("/dev/null", O_WRONLY, &fds[1]);
+
+    if (opened && head->errorToOutput)
+    {
+        fds[2] = fcntl(fds[1] != -1 ? fds[1] : STDOUT_FILENO,
+                F_DUPFD_CLOEXEC, 3);
+        opened = fds[2] != -1;
+    }
+    else if (opened && head->redirError)
+        opened = openRedirect(head->redirError, O_WRONLY | O_CREAT
+                | (head->appendError ? O_APPEND : O_TRUNC), &fds[2]);
+
+    if (! opened)
+        closeRedirects(fds);
+    return opened;
+}
+
+/* setRedirects **************************************************************\
+ * SetRedirects puts the descriptors from `openRedirects` in place as the
+ *  child process's input, output and errors.
+ * Accepts:
+ *  fds (int[]): Descriptors for input, output and errors (-1 for none)
  * Returns:
  *  Nothing
  *****************************************************************************/
-void setOutput(struct argument *head)
+void setRedirects(int fds[])
 {
-    int targetFD;
-    // Specify a file name if given by user
-    if (head->redirOutput || head->background)
+    for (int i = 0; i < 3; i++)
     {
-        if (head->redirOutput)
-        {
-            targetFD = open(head->redirOutput, 
-                    O_WRONLY | O_CREAT | O_TRUNC, 0666);
-        }
-        else if (head->background)
+        if (fds[i] != -1 && dup2(fds[i], i) == -1)
         {
-            targetFD = open("/dev/null", 
-                    O_WRONLY | O_CREAT | O_TRUNC, 0666);
-        }
-        if (targetFD == -1)
-        {
-            perror("Cannot open file to write");
+            perror("Cannot redirect to file");
             exit(1);
         }
-        else
-        {
-            int result = dup2(targetFD, 1);
-            if (result == -1)
-            {
-                perror("Cannot redirect input to file");
-                exit(1);
-            }
-        }
     }
     return;
 }
- /* setInput ******************************************************************\
- * SetInput takes information from the head of the linked list of words, and 
- *  sets input accordingly (from file, or from `/dev/null` if background
- *  without file specification.
+
+/* closeRedirects ************************************************************\
+ * CloseRedirects closes the descriptors from `openRedirects`.
  * Accepts:
- *  head (struct argument *): Location of head of linked list of words
+ *  fds (int[]): Descriptors for input, output and errors (-1 for none)
  * Returns:
  *  Nothing
  *****************************************************************************/
-void setInput(struct argument *head)
+void closeRedirects(int fds[])
+{
+    for (int i = 0; i < 3; i++)
+    {
+        if (fds[i] != -1)
+            close(fds[i]);
+        fds[i] = -1;
+    }
+    return;
+}
+
+/* hereDocument **************************************************************\
+ * HereDocument puts the body of a here-string or here-document into an
+ *  in-memory file (`memfd_create`), so it never reaches the filesystem.  If
+ *  that is not available, a pipe is used for bodies that fit in its buffer.
+ * Accepts:
+ *  body (char *): Text to put in the file
+ *  length (size_t): Length of text
+ * Returns:
+ *  Descriptor to read the body from, or -1 on error
+ *****************************************************************************/
+int hereDocument(char *body, size_t length)
 {
-    int sourceFD;
+    int fd = memfd_create("smallsh-here", MFD_CLOEXEC);
+    int pipeFD[2];
 
-    // Specify a file name if given by user
-    if (head->redirInput || head->background)
+    if (fd == -1 && length <= PIPE_BUF && pipe2(pipeFD, O_CLOEXEC) == 0)
+    {
+        write(pipeFD[1], body, length);
+        close(pipeFD[1]);
+        return pipeFD[0];
+    }
+    if (fd == -1)
+    {
+        perror("Cannot create here-document");
+        return -1;
+    }
+    size_t written = 0;
+    while (written < length)
     {
-        if (head->redirInput)
-            sourceFD = open(head->redirInput, O_RDONLY);
-        else if (head->background)
-            sourceFD = open("/dev/null", O_RDONLY);
-        if (sourceFD == -1)
+        ssize_t result = write(fd, body + written, length - written);
+        if (result == -1)
         {
-            perror("Cannot open file to read");
-            exit(1);
+            perror("Cannot write here-document");
+            close(fd);
+            return -1;
         }
-        else
+        written += result;
+    }
+    return fd;
+}
+
+/* readHereDocument **********************************************************\
+ * ReadHereDocument reads the lines of a here-document, up to the delimiter
+ *  line (or end of input), expanding `$$` in each.  Lines are read with
+ *  `getline`, so they have no length limit, and the expanded text is
+ *  gathered in a buffer and written to the in-memory file a block at a time.
+ * Accepts:
+ *  stream (FILE *): Stream to read the lines from
+ *  head (struct argument *): Location of head of command with `hereDelim`
+ *  processID (pid_t): ProcessID of current process
+ * Returns:
+ *  True if the here-document was stored.  False, otherwise.
+ *****************************************************************************/
+bool readHereDocument(FILE *stream, struct argument *head, pid_t processID)
+{
+    char *line = NULL;
+    size_t size = 0;
+    ssize_t got;
+    char pid[24];
+    int pidLength = snprintf(pid, sizeof(pid), "%d", processID);
+    char block[HERE_BUFFER];
+    size_t length = 0;
+    int fd = memfd_create("smallsh-here", MFD_CLOEXEC);
+    bool stored = fd != -1;
+
+    if (fd == -1)
+        perror("Cannot create here-document");
+    while (true)
+    {
+        if (stream == stdin)
+        {
+            printf("> ");
+            fflush(stdout);
+        }
+        if ((got = getline(&line, &size, stream)) == -1)
+            break;
+        if (got > 0 && line[got - 1] == '\n')
+            line[--got] = '\0';
+        if (! strcmp(line, head->hereDelim))
+            break;
+        lineNumber++;
+        // expand the line (and its newline) into the block, writing the
+        //  block out whenever a pid might not fit
+        for (ssize_t r = 0; stored && r <= got; r++)
         {
-            int result = dup2(sourceFD, 0);
-            if (result == -1)
+            if (length + pidLength + 1 > HERE_BUFFER)
             {
-                perror("Cannot redirect input to file");
-                exit(1);
+                stored = write(fd, block, length) == (ssize_t)length;
+                length = 0;
             }
+            if (r == got)
+                block[length++] = '\n';
+            else if (line[r] == '$' && line[r + 1] == '$')
+            {
+                memcpy(block + length, pid, pidLength);
+                length += pidLength;
+                r++;
+            }
+            else
+                block[length++] = line[r];
+        }
+    }
+    lineNumber++;
+    free(line);
+    if (stored && length > 0)
+        stored = write(fd, block, length) == (ssize_t)length;
+
+    free(head->hereDelim);
+    head->hereDelim = NULL;
+    if (! stored)
+    {
+        if (fd != -1)
+        {
+            perror("Cannot write here-document");
+            close(fd);
         }
+        return false;
     }
+    head->hereFD = fd;
+    return true;
+}
+
+/* replaceText ***************************************************************\
+ * ReplaceText sets a text field of an `argument` struct to a copy of some
+ *  text, freeing what was there before.
+ * Accepts:
+ *  field (char **): Location of field
+ *  text (char *): Text to copy
+ * Returns:
+ *  Nothing
+ *****************************************************************************/
+void replaceText(char **field, char *text)
+{
+    free(*field);
+    *field = calloc(strlen(text)+1, sizeof(char));
+    strcpy(*field, text);
     return;
 }
- 
+
 /* redirectIO ****************************************************************\
- * RedirectIO looks at linked list of input words to see if penultimate word
- *  signals IO redirection, and sets head's property accordingly.
+ * RedirectIO looks through the linked list of input words, after the
+ *  command, for IO redirections, and sets head's properties accordingly.
+ *  Each redirection's words are removed from the list; when one is given
+ *  twice, the last one counts.  A here-string (`<<<`) is stored right away;
+ *  a here-document (`<<`) only records its delimiter, for `getInput` to read
+ *  the lines.
  * Accepts:
  *  head (struct argument *): Location of head of linked list
  * Returns:
- *  True if such a redirection occurred.  False otherwise.
+ *  True if the redirections were good.  False if one was missing its file.
  *****************************************************************************/
 bool redirectIO(struct argument *head)
 {
-    if (head->next == NULL)
-        return false;
-    
-    struct argument *current = head->next;
     struct argument *previous = head;
-    struct argument *prevprev = NULL;
+    struct argument *current = head->next;
 
-    while (current->next != NULL)
-    {
-        prevprev = previous;
-        previous = current;
-        current = current->next;
-    }
-    if ( ! strcmp(previous->text, ">"))
+    while (current != NULL)
     {
-        head->redirOutput = calloc(strlen(current->text)+1, sizeof(char));
-        strcpy(head->redirOutput, current->text);
-        if (prevprev != NULL)
+        char *word = current->text;
+        struct argument *target = current->next;
+        int skip = 2;                       // words taken by redirection
+
+        if (! strcmp(word, "2>&1"))
+        {
+            free(head->redirError);
+            head->redirError = NULL;
+            head->errorToOutput = true;
+            skip = 1;
+        }
+        else if (strcmp(word, "<") && strcmp(word, ">") && strcmp(word, ">>")
+                && strcmp(word, "2>") && strcmp(word, "2>>")
+                && strcmp(word, "&>") && strcmp(word, "&>>")
+                && strcmp(word, "<<<") && strcmp(word, "<<"))
+        {
+            previous = current;
+            current = current->next;
+            continue;
+        }
+        else if (target == NULL)
+        {
+            fprintf(stderr, "smallsh: missing file after `%s'\n", word);
+            return false;
+        }
+        else if (! strcmp(word, "<"))
+            replaceText(&head->redirInput, target->text);
+        else if (word[0] == '>' || word[0] == '&')
+        {
+            replaceText(&head->redirOutput, target->text);
+            head->appendOutput = ! strcmp(word, ">>")
+                || ! strcmp(word, "&>>");
+            if (word[0] == '&')
+            {
+                free(head->redirError);
+                head->redirError = NULL;
+                head->errorToOutput = true;
+            }
+        }
+        else if (word[0] == '2')
         {
-            prevprev->next = NULL;
-            freeArguments(previous);
+            replaceText(&head->redirError, target->text);
+            head->appendError = ! strcmp(word, "2>>");
+            head->errorToOutput = false;
+        }
+        else
+        {
+            if (head->hereFD != -1)
+                close(head->hereFD);
+            head->hereFD = -1;
+            free(head->hereDelim);
+            head->hereDelim = NULL;
+            if (word[2] == '<')
+            {
+                // here-string gets a newline at the end, like other shells
+                target->text = realloc(target->text,
+                        strlen(target->text) + 2);
+                strcat(target->text, "\n");
+                head->hereFD = hereDocument(target->text,
+                        strlen(target->text));
+            }
+            else
+                replaceText(&head->hereDelim, target->text);
         }
 
-        return true;
-    }
-    if ( ! strcmp(previous->text, "<"))
-    {
-        head->redirInput = calloc(strlen(current->text)+1, sizeof(char));
-        strcpy(head->redirInput, current->text);
-        if (prevprev != NULL)
-            prevprev->next = NULL;
-        freeArguments(previous);
-        return true;
+        // Cut the redirection's words out of the list
+        struct argument *last = skip == 2 ? target : current;
+        previous->next = last->next;
+        last->next = NULL;
+        freeArguments(current);
+        current = previous->next;
     }
 
-    return false;
+    return true;
 }
 
 /* setBackground *************************************************************\
@@ -437,422 +1105,2822 @@ void createProcessArguments(char **arguments, struct argument *head)
     return;
 }
 
-/* otherProcess **************************************************************\
- * OtherProcess uses `fork` and `execv` to run processes that are neither
- *  comments nor built-in processes. (Overall logic structure copied from
- *  OSU CS344 Fall 2020 Canvas page "Exploration API - Executing a New
- *  Program")
+/* parseLimit ****************************************************************\
+ * ParseLimit reads one `name=value` limit setting, such as `mem=2G`,
+ *  `cpu=30s` or `nofile=4096`.  Sizes take K, M, G or T; times take s, m or
+ *  h; any value may be `unlimited`.  Values that are negative, or too big
+ *  to be a limit, are refused.
  * Accepts:
- *  head (struct argument *): Location of first argument
- *  children (struct childProc *): Location of children processes linked list
- *  exitStatus (struct endStatus *): Location of endStatus struct.  For
- *      storing information needed by`status` built-in command
- *  SIGINT_action (struct sigaction): Struct for handling SIGINT
- *  SIGTSTP_action (struct sigaction): Struct for handling SIGTSTP
+ *  word (char *): Limit setting as typed
+ *  limits (struct limits *): Location of limits to update
  * Returns:
- *  head of linked list of childProc
+ *  True if the setting was valid.  False, otherwise.
  *****************************************************************************/
-struct childProc *otherProcess(struct argument *head, 
-        struct childProc *children, struct endStatus *exitStatus,
-        struct sigaction SIGINT_action, struct sigaction SIGTSTP_action)
+bool parseLimit(char *word, struct limits *limits)
 {
+    char *equals = strchr(word, '=');
+    int index = -1;
 
-    int childStatus;
-    char *arguments[MAX_ARGUMENTS] = {NULL};
+    for (int i = 0; equals != NULL && i < LIMIT_COUNT; i++)
+    {
+        if (strlen(limitNames[i].name) == (size_t)(equals - word)
+                && ! strncmp(limitNames[i].name, word, equals - word))
+            index = i;
+    }
+    if (index == -1)
+    {
+        fprintf(stderr, "limit: unknown setting `%s`\n", word);
+        return false;
+    }
 
-    // Look for IO redirection, up to twice
-    if ( redirectIO(head))
-        redirectIO(head);
+    char *value = equals + 1;
+    if (! strcmp(value, "unlimited"))
+    {
+        limits->set[index] = true;
+        limits->value[index] = RLIM_INFINITY;
+        return true;
+    }
+    char *end;
+    errno = 0;
+    unsigned long long number = strtoull(value, &end, 10);
+    unsigned long long scale = 1;
+    // strtoull takes a sign (wrapping `-5` around) and leading space
+    if (end == value || *value < '0' || *value > '9' || errno == ERANGE)
+        end = "?";
+    else if (limitNames[index].unit == 'b' && *end != '\0')
+    {
+        char *suffixes = "KMGT";
+        char *suffix = strchr(suffixes, *end);
+        for (int i = 0; suffix != NULL && i <= suffix - suffixes; i++)
+            scale *= 1024;
+        end += suffix != NULL;
+    }
+    else if (limitNames[index].unit == 's' && *end != '\0')
+    {
+        if (*end == 'm')
+            scale = 60;
+        else if (*end == 'h')
+            scale = 3600;
+        end += *end == 's' || *end == 'm' || *end == 'h';
+    }
+    // the scaled value must stay below RLIM_INFINITY
+    if (*end != '\0' || number > (RLIM_INFINITY - 1) / scale)
+    {
+        fprintf(stderr, "limit: bad value in `%s`\n", word);
+        return false;
+    }
+    limits->set[index] = true;
+    limits->value[index] = number * scale;
+    return true;
+}
 
-    pid_t newID = -8;
-    newID = fork();
-    switch (newID)
+/* applyLimits ***************************************************************\
+ * ApplyLimits sets the given resource limits on the current process.  It is
+ *  used in the child, between `fork` and `execvp`.  The CPU hard limit is one
+ *  second past the soft limit, so SIGXCPU arrives before SIGKILL.
+ * Accepts:
+ *  limits (struct limits *): Location of limits to apply
+ * Returns:
+ *  Nothing
+ *****************************************************************************/
+void applyLimits(struct limits *limits)
+{
+    for (int i = 0; i < LIMIT_COUNT; i++)
     {
-        case -1:
-            // Error forking
-            perror("fork()\n");
+        if (! limits->set[i])
+            continue;
+        struct rlimit limit = { limits->value[i], limits->value[i] };
+        if (limitNames[i].resource == RLIMIT_CPU
+                && limit.rlim_max != RLIM_INFINITY)
+            limit.rlim_max++;
+        if (setrlimit(limitNames[i].resource, &limit) == -1)
+        {
+            perror(limitNames[i].name);
             exit(1);
+        }
+    }
+    return;
+}
+
+/* printLimits ***************************************************************\
+ * PrintLimits prints a set of limits for the `ulimit` built-in command.
+ *  Limits that were not given are shown as `inherited`.
+ * Accepts:
+ *  limits (struct limits *): Location of limits to print
+ * Returns:
+ *  Nothing
+ *****************************************************************************/
+void printLimits(struct limits *limits)
+{
+    for (int i = 0; i < LIMIT_COUNT; i++)
+    {
+        printf("%s=", limitNames[i].name);
+        if (! limits->set[i])
+            printf("inherited\n");
+        else if (limits->value[i] == RLIM_INFINITY)
+            printf("unlimited\n");
+        else
+            printf("%llu%s\n", (unsigned long long)limits->value[i],
+                    limitNames[i].unit == 's' ? "s" : "");
+    }
+    fflush(stdout);
+    return;
+}
+
+/* setLimits *****************************************************************\
+ * SetLimits removes a `limit name=value ...` prefix from the linked list of
+ *  words, and records the limits in the new head.
+ * Accepts:
+ *  head (struct argument *): Location of head of linked list (`limit`)
+ * Returns:
+ *  New head of linked list (NULL, with list freed, if prefix was bad)
+ *****************************************************************************/
+struct argument *setLimits(struct argument *head)
+{
+    struct limits *limits = calloc(1, sizeof(struct limits));
+    struct argument *current = head->next;
+    struct argument *previous = head;
+
+    while (current != NULL && strchr(current->text, '=') != NULL)
+    {
+        if (! parseLimit(current->text, limits))
             break;
+        previous = current;
+        current = current->next;
+    }
+    if (current == NULL || strchr(current->text, '=') != NULL)
+    {
+        if (current == NULL)
+            fprintf(stderr, "usage: limit name=value ... command\n");
+        free(limits);
+        freeArguments(head);
+        return NULL;
+    }
+
+    // Cut prefix off, and renumber the remaining words
+    previous->next = NULL;
+    freeArguments(head);
+    head = current;
+    head->limits = limits;
+    for (int i = 0; current != NULL; current = current->next)
+        current->position = i++;
+    return head;
+}
+
+/* setEndStatus **************************************************************\
+ * SetEndStatus records how a child process ended, as reported by `wait4`.
+ *  A signal that the kernel sends for a CPU time or file size limit is
+ *  recorded as that limit, when the limit applied to the command.  SIGKILL
+ *  only counts as the CPU limit if the child's CPU time reached the hard
+ *  limit, so other kills (`kill -9`, the OOM killer) are not blamed on it.
+ * Accepts:
+ *  exitStatus (struct endStatus *): Location of endStatus struct to fill
+ *  childStatus (int): Status information from `wait4`
+ *  usage (struct rusage *): Resource usage of child, from `wait4`
+ *  head (struct argument *): Location of head of command that ended
+ * Returns:
+ *  Nothing
+ *****************************************************************************/
+void setEndStatus(struct endStatus *exitStatus, int childStatus,
+        struct rusage *usage, struct argument *head)
+{
+    exitStatus->limit = NULL;
+    if (WIFEXITED(childStatus))
+    {
+        exitStatus->exit = true;
+        exitStatus->num = WEXITSTATUS(childStatus);
+        return;
+    }
+    exitStatus->exit = false;
+    exitStatus->num = WTERMSIG(childStatus);
+
+    // CPU limit (`limitNames[0]`): SIGXCPU at the soft limit, SIGKILL at the
+    //  hard limit.  File size limit (`limitNames[2]`): SIGXFSZ.
+    int limit = -1;
+    if (exitStatus->num == SIGXCPU || exitStatus->num == SIGKILL)
+        limit = 0;
+    else if (exitStatus->num == SIGXFSZ)
+        limit = 2;
+    if (limit == -1)
+        return;
+    // Command's own limit takes the place of the shell's
+    struct limits *limits = head->limits != NULL && head->limits->set[limit]
+        ? head->limits : &shellLimits;
+    if (! limits->set[limit])
+        return;
+    if (exitStatus->num == SIGKILL)
+    {
+        // hard CPU limit is one second past the soft limit (`applyLimits`);
+        //  reported CPU time may fall short of it by up to CPU_SLACK us
+        long long used = ((long long)usage->ru_utime.tv_sec
+                + usage->ru_stime.tv_sec) * 1000000
+            + usage->ru_utime.tv_usec + usage->ru_stime.tv_usec;
+        if (limits->value[limit] == RLIM_INFINITY || used + CPU_SLACK
+                < ((long long)limits->value[limit] + 1) * 1000000)
+            return;
+    }
+    exitStatus->limit = limitNames[limit].name;
+    return;
+}
+
+/* execChild *****************************************************************\
+ * ExecChild sets up a new child process for its command and runs it with
+ *  `execvp`.  It does not return.
+ * Accepts:
+ *  head (struct argument *): Location of first argument
+ *  limits (struct limits *): Resource limits for the command
+ *  arguments (char *[]): Arguments for `execvp`, ending with NULL
+ *  redirect (int[]): Descriptors for input, output and errors (-1 for none)
+ *  SIGINT_action (struct sigaction): Struct for handling SIGINT
+ *  SIGTSTP_action (struct sigaction): Struct for handling SIGTSTP
+ * Returns:
+ *  Nothing
+ *****************************************************************************/
+void execChild(struct argument *head, struct limits *limits,
+        char *arguments[], int redirect[], struct sigaction SIGINT_action,
+        struct sigaction SIGTSTP_action)
+{
+    sigset_t noSignals;
+    // Start with no signals blocked (`watch` blocks SIGINT in the shell)
+    sigemptyset(&noSignals);
+    sigprocmask(SIG_SETMASK, &noSignals, NULL);
+    // If background, start a process group so `exit` can signal the
+    //  whole job at once
+    if (head->background)
+        setpgid(0, 0);
+    // If foreground, change SIGINT and SIGTSTP handlers
+    if (! head->background)
+    {
+        SIGTSTP_action.sa_handler = SIG_IGN;
+        sigaction(SIGTSTP, &SIGTSTP_action, NULL);
+        SIGINT_action.sa_handler = SIG_DFL;
+        sigfillset(&SIGINT_action.sa_mask);
+        SIGINT_action.sa_flags = 0;
+        sigaction(SIGINT, &SIGINT_action, NULL);
+    }
+    applyLimits(limits);
+    setRedirects(redirect);
+    execvp(arguments[0], arguments);
+    perror(arguments[0]);
+    exit(1);
+}
+
+/* startSpawnHelper **********************************************************\
+ * StartSpawnHelper forks the spawn helper (`--spawn-helper`), a small
+ *  process that starts commands for the shell.  Its `fork` stays cheap
+ *  however large the shell grows, because the helper stays small.
+ * Accepts:
+ *  Nothing
+ * Returns:
+ *  True if the helper is running.  False, otherwise.
+ *****************************************************************************/
+bool startSpawnHelper(void)
+{
+    int sockets[2];
+
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sockets) == -1)
+    {
+        perror("Cannot start spawn helper");
+        return false;
+    }
+    switch (fork())
+    {
+        case -1:
+            perror("Cannot start spawn helper");
+            close(sockets[0]);
+            close(sockets[1]);
+            return false;
         case 0:
-            // Child process
-            // If foreground, change SIGINT and SIGTSTP handlers
-            if (! head->background)
+            close(sockets[0]);
+            runSpawnHelper(sockets[1]);
+            break;
+        default:
+            close(sockets[1]);
+            spawnHelper = sockets[0];
+            break;
+    }
+    return true;
+}
+
+/* runSpawnHelper ************************************************************\
+ * RunSpawnHelper is the spawn helper's main loop.  For each request it
+ *  starts the command with `clone(CLONE_PARENT)`, so the command is the
+ *  shell's child (for `waitpid`, `setpgid` and SIGCHLD), and replies with
+ *  its <pid> (-1 if it could not).  It ends when the shell closes the
+ *  socket.
+ * Accepts:
+ *  socketFD (int): Helper's end of the socket to the shell
+ * Returns:
+ *  Nothing (does not return)
+ *****************************************************************************/
+void runSpawnHelper(int socketFD)
+{
+    struct sigaction action;
+    action.sa_handler = SIG_IGN;
+    sigfillset(&action.sa_mask);
+    action.sa_flags = 0;
+    // SIGINT and SIGTSTP from the terminal are for the shell's command
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTSTP, &action, NULL);
+    if (trace.fd != -1)
+        close(trace.fd);
+    trace.fd = -1;
+
+    while (true)
+    {
+        struct spawnRequest request;
+        union
+        {
+            char buffer[CMSG_SPACE(5 * sizeof(int))];
+            struct cmsghdr align;
+        } control;
+        int fds[5] = {-1, -1, -1, -1, -1};
+        int fdCount = 0;
+        int redirect[3] = {-1, -1, -1};
+
+        ssize_t size = recv(socketFD, NULL, 0, MSG_PEEK | MSG_TRUNC);
+        if (size < (ssize_t)sizeof(request))
+            exit(0);
+        char *strings = malloc(size - sizeof(request) + 1);
+        struct iovec parts[2] = {
+            { &request, sizeof(request) },
+            { strings, size - sizeof(request) }
+        };
+        struct msghdr message = { 0 };
+        message.msg_iov = parts;
+        message.msg_iovlen = 2;
+        message.msg_control = control.buffer;
+        message.msg_controllen = sizeof(control.buffer);
+        if (recvmsg(socketFD, &message, MSG_CMSG_CLOEXEC) != size)
+            exit(0);
+        struct cmsghdr *header = CMSG_FIRSTHDR(&message);
+        if (header != NULL && header->cmsg_type == SCM_RIGHTS)
+        {
+            fdCount = (header->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            memcpy(fds, CMSG_DATA(header), fdCount * sizeof(int));
+        }
+        for (int i = 0, next = 1; i < 3; i++)
+            if (request.redirected[i])
+                redirect[i] = fds[next++];
+
+        // Point into the strings for the arguments and environment
+        char **arguments = calloc(request.argCount + 1, sizeof(char *));
+        char **environment = calloc(request.envCount + 1, sizeof(char *));
+        char *cursor = strings;
+        for (int i = 0; i < request.argCount; i++, cursor += strlen(cursor) + 1)
+            arguments[i] = cursor;
+        for (int i = 0; i < request.envCount; i++, cursor += strlen(cursor) + 1)
+            environment[i] = cursor;
+
+        pid_t newID = syscall(SYS_clone, CLONE_PARENT | SIGCHLD, 0, NULL,
+                NULL, 0);
+        if (newID == 0)
+        {
+            // Command: rebuild just what `execChild` looks at
+            close(socketFD);
+            if (fchdir(fds[0]) == -1)
             {
-                SIGTSTP_action.sa_handler = SIG_IGN;
-                sigaction(SIGTSTP, &SIGTSTP_action, NULL);
-                SIGINT_action.sa_handler = SIG_DFL;
-                sigfillset(&SIGINT_action.sa_mask);
-                SIGINT_action.sa_flags = 0;
-                sigaction(SIGINT, &SIGINT_action, NULL);
+                perror("Cannot change directory");
+                exit(1);
             }
-            setInput(head);
-            setOutput(head);
-            createProcessArguments(arguments, head);
-             execvp(arguments[0], arguments);
-            perror(arguments[0]);
-            freeArguments(head);
-            freeChildren(children);
-            free(exitStatus);
+            struct argument *head = makeArgument(arguments[0]);
+            head->background = request.background;
+            // a background command gets SIGTSTP as the shell's would, once
+            //  `exec` resets the shell's handler
+            if (request.background)
+            {
+                action.sa_handler = SIG_DFL;
+                sigaction(SIGTSTP, &action, NULL);
+            }
+            environ = environment;
+            execChild(head, &request.limits, arguments, redirect, action,
+                    action);
+        }
+
+        for (int i = 0; i < fdCount; i++)
+            close(fds[i]);
+        free(arguments);
+        free(environment);
+        free(strings);
+        send(socketFD, &newID, sizeof(newID), MSG_NOSIGNAL);
+    }
+}
+
+/* requestSpawn **************************************************************\
+ * RequestSpawn asks the spawn helper to start a process for the linked list
+ *  of words.  If the helper stops answering, it is not used again.
+ * Accepts:
+ *  head (struct argument *): Location of first argument
+ *  limits (struct limits *): Resource limits for the command
+ *  redirect (int[]): Descriptors for input, output and errors (-1 for none)
+ *  execFD (int): Write end of trace pipe, closed on `exec`, or -1
+ * Returns:
+ *  <pid> of the new process, or -1 if the helper did not start it
+ *****************************************************************************/
+pid_t requestSpawn(struct argument *head, struct limits *limits,
+        int redirect[], int execFD)
+{
+    struct spawnRequest request = { 0 };
+    union
+    {
+        char buffer[CMSG_SPACE(5 * sizeof(int))];
+        struct cmsghdr align;
+    } control;
+    int fds[5];
+    int fdCount = 0;
+    size_t length = 0;
+    pid_t newID = -1;
+
+    // Lay the strings out one after another
+    request.background = head->background;
+    request.limits = *limits;
+    for (struct argument *current = head; current != NULL;
+            current = current->next, request.argCount++)
+        length += strlen(current->text) + 1;
+    for (char **variable = environ; *variable != NULL;
+            variable++, request.envCount++)
+        length += strlen(*variable) + 1;
+    char *strings = malloc(length);
+    char *cursor = strings;
+    for (struct argument *current = head; current != NULL;
+            current = current->next)
+        cursor = stpcpy(cursor, current->text) + 1;
+    for (char **variable = environ; *variable != NULL; variable++)
+        cursor = stpcpy(cursor, *variable) + 1;
+
+    fds[fdCount++] = open(".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fds[0] == -1)
+    {
+        free(strings);
+        return -1;
+    }
+    for (int i = 0; i < 3; i++)
+    {
+        request.redirected[i] = redirect[i] != -1;
+        if (request.redirected[i])
+            fds[fdCount++] = redirect[i];
+    }
+    request.traced = execFD != -1;
+    if (request.traced)
+        fds[fdCount++] = execFD;
+
+    struct iovec parts[2] = {
+        { &request, sizeof(request) },
+        { strings, length }
+    };
+    struct msghdr message = { 0 };
+    message.msg_iov = parts;
+    message.msg_iovlen = 2;
+    message.msg_control = control.buffer;
+    message.msg_controllen = CMSG_SPACE(fdCount * sizeof(int));
+    struct cmsghdr *header = CMSG_FIRSTHDR(&message);
+    header->cmsg_level = SOL_SOCKET;
+    header->cmsg_type = SCM_RIGHTS;
+    header->cmsg_len = CMSG_LEN(fdCount * sizeof(int));
+    memcpy(CMSG_DATA(header), fds, fdCount * sizeof(int));
+
+    ssize_t sent = sendmsg(spawnHelper, &message, MSG_NOSIGNAL);
+    close(fds[0]);
+    free(strings);
+    // A request too large for one message just falls back to `fork`
+    if (sent == -1 && errno == EMSGSIZE)
+        return -1;
+    if (sent == -1
+            || recv(spawnHelper, &newID, sizeof(newID), 0) != sizeof(newID))
+    {
+        perror("Spawn helper stopped");
+        close(spawnHelper);
+        spawnHelper = -1;
+        return -1;
+    }
+    return newID;
+}
+
+/* spawnProcess **************************************************************\
+ * SpawnProcess uses `fork` and `execvp` to start a process for the linked
+ *  list of words, without waiting for it. (Overall logic structure copied
+ *  from OSU CS344 Fall 2020 Canvas page "Exploration API - Executing a New
+ *  Program")  With the spawn helper, the helper starts it instead, falling
+ *  back to `fork` if it cannot.  Redirections are opened first, so nothing
+ *  is started if one cannot be.  When tracing, the `exec` span ends when a
+ *  close-on-exec pipe shared with the child closes.
+ * Accepts:
+ *  head (struct argument *): Location of first argument
+ *  SIGINT_action (struct sigaction): Struct for handling SIGINT
+ *  SIGTSTP_action (struct sigaction): Struct for handling SIGTSTP
+ * Returns:
+ *  <pid> of the new process, or -1 if a redirection could not be opened
+ *****************************************************************************/
+pid_t spawnProcess(struct argument *head, struct sigaction SIGINT_action,
+        struct sigaction SIGTSTP_action)
+{
+    char *arguments[MAX_ARGUMENTS] = {NULL};
+    int execPipe[2] = {-1, -1};
+    int redirect[3];
+    char ignored;
+
+    if (! openRedirects(head, redirect))
+        return -1;
+
+    // Command's own limits take the place of the shell's
+    struct limits limits = shellLimits;
+    for (int i = 0; head->limits != NULL && i < LIMIT_COUNT; i++)
+    {
+        if (head->limits->set[i])
+        {
+            limits.set[i] = true;
+            limits.value[i] = head->limits->value[i];
+        }
+    }
+
+    if (trace.fd != -1 && pipe2(execPipe, O_CLOEXEC) == -1)
+        execPipe[0] = execPipe[1] = -1;
+    long long start = traceTime();
+    pid_t newID = -1;
+    if (spawnHelper != -1)
+        newID = requestSpawn(head, &limits, redirect, execPipe[1]);
+    if (newID == -1)
+        newID = fork();
+    switch (newID)
+    {
+        case -1:
+            // Error forking
+            perror("fork()\n");
             exit(1);
+            break;
+        case 0:
+            // Child process
+            createProcessArguments(arguments, head);
+            execChild(head, &limits, arguments, redirect, SIGINT_action,
+                    SIGTSTP_action);
+            break;
         default:
             // Parent process
-            children = createChildProc(children, newID);
-            if (! head->background)
-            {
-                newID = waitpid(newID, &childStatus, 0);
-                if (WIFEXITED(childStatus))
-                {
-                    exitStatus->exit = true;
-                    exitStatus->num = WEXITSTATUS(childStatus);
-                }
-                else
-                {
-                    exitStatus->exit = false;
-                    exitStatus->num = WTERMSIG(childStatus);
-                    if (WTERMSIG(childStatus) == 2)
-                    {
-                        printf("terminated by signal %d\n", 
-                                WTERMSIG(childStatus));
-                        fflush(stdout);
-                    }
-                }
-                children = removeChildProc(children, newID);
-            }
-            else
+            closeRedirects(redirect);
+            // Also set the process group here, so it exists before any
+            //  `killpg`, whichever process runs first
+            if (head->background)
+                setpgid(newID, newID);
+            if (trace.fd == -1)
+                break;
+            long long forked = traceTime();
+            traceEvent("spawn", newID, head->line, start, forked);
+            if (execPipe[0] != -1)
             {
-                printf("background pid is %d\n", newID);
-                fflush(stdout);
+                close(execPipe[1]);
+                while (read(execPipe[0], &ignored, 1) > 0)
+                    ;
+                close(execPipe[0]);
+                traceEvent("exec", newID, head->line, forked, traceTime());
             }
             break;
     }
+    return newID;
+}
+
+/* otherProcess **************************************************************\
+ * OtherProcess runs processes that are neither comments nor built-in
+ *  processes, waiting for them if they are in the foreground.
+ * Accepts:
+ *  head (struct argument *): Location of first argument
+ *  children (struct childProc *): Location of children processes linked list
+ *  exitStatus (struct endStatus *): Location of endStatus struct.  For
+ *      storing information needed by`status` built-in command
+ *  SIGINT_action (struct sigaction): Struct for handling SIGINT
+ *  SIGTSTP_action (struct sigaction): Struct for handling SIGTSTP
+ * Returns:
+ *  head of linked list of childProc
+ *****************************************************************************/
+struct childProc *otherProcess(struct argument *head,
+        struct childProc *children, struct endStatus *exitStatus,
+        struct sigaction SIGINT_action, struct sigaction SIGTSTP_action)
+{
+    int childStatus;
+    struct rusage usage;
+    pid_t newID = spawnProcess(head, SIGINT_action, SIGTSTP_action);
+
+    // Nothing was started if a redirection could not be opened
+    if (newID == -1)
+    {
+        if (! head->background)
+        {
+            exitStatus->exit = true;
+            exitStatus->num = 1;
+            exitStatus->limit = NULL;
+        }
+        return children;
+    }
+    children = createChildProc(children, newID, head->line);
+    if (! head->background)
+    {
+        long long start = traceTime();
+        newID = wait4(newID, &childStatus, 0, &usage);
+        traceEvent("wait", newID, head->line, start, traceTime());
+        setEndStatus(exitStatus, childStatus, &usage, head);
+        if (! exitStatus->exit && exitStatus->num == 2)
+        {
+            printf("terminated by signal %d\n", exitStatus->num);
+            fflush(stdout);
+        }
+        children = removeChildProc(children, newID);
+    }
+    else
+    {
+        printf("background pid is %d\n", newID);
+        fflush(stdout);
+    }
     return children;
 }
 
-/* printStatus ***************************************************************\
- * PrintStatus prints the required information for `status` built-in command.
+/* printStatus ***************************************************************\
+ * PrintStatus prints the required information for `status` built-in command.
+ * Accepts:
+ *  exitStatus (struct endStatus *): Location of struct endStatus, with
+ *      exit/termination information
+ * Returns:
+ *  Nothing
+ *****************************************************************************/
+void printStatus(struct endStatus *exitStatus)
+{
+    if (exitStatus->exit == true)
+        printf("exit value ");
+    else
+        printf("terminated by signal ");
+    printf("%d", exitStatus->num);
+    if (exitStatus->limit != NULL)
+        printf(" (%s limit exceeded)", exitStatus->limit);
+    printf("\n");
+    fflush(stdout);
+
+    return;
+}
+/* changeDir *****************************************************************\
+ * ChangeDir changes the working directory.  It defaults to the user's HOME
+ *  directory.
+ * Accepts:
+ *  head (struct arguemnt *): Memory location of first word in user input
+ * Returns:
+ *  True if the directory was changed.  False, otherwise.
+ *****************************************************************************/
+bool changeDir(struct argument *head)
+{
+    char *path = head->next == NULL ? getenv("HOME") : head->next->text;
+
+    if (path == NULL || chdir(path) == -1)
+    {
+        perror("cd");
+        return false;
+    }
+    return true;
+}
+
+/* signalChildren ************************************************************\
+ * SignalChildren sends a signal to the process group of each process in the
+ *  linked list of childProcs, without waiting for any of them.
+ * Accepts:
+ *  head (struct childProc *): Location of first childProc
+ *  sig (int): Signal number
+ * Returns:
+ *  Number of childProcs in the linked list (int)
+ *****************************************************************************/
+int signalChildren(struct childProc *head, int sig)
+{
+    int count = 0;
+    while (head != NULL)
+    {
+        // fall back to the process itself if its group is already gone
+        if (killpg(head->id, sig) == -1)
+            kill(head->id, sig);
+        head = head->next;
+        count++;
+    }
+    return count;
+}
+
+/* killChildren **************************************************************\
+ * KillChildren will kill the processes in the linked list of childProcs.
+ *  Every process group gets SIGTERM at once, and children are reaped in
+ *  whatever order they end.  Any still running after `killGrace`
+ *  milliseconds get SIGKILL.  A summary is printed when there were children.
+ * Accepts:
+ *  head (struct childProc *): Location of first childProc
+ * Returns:
+ *  Nothing
+ *****************************************************************************/
+void killChildren(struct childProc *head)
+{
+    int childStatus;
+    int exited = 0;                         // children that exited
+    int terminated = 0;                     // children that ended by signal
+    int killed = 0;                         // children that needed SIGKILL
+    bool escalated = false;
+    sigset_t childSignal;
+    sigset_t oldMask;
+
+    // Block SIGCHLD so it stays pending for `sigtimedwait` below
+    sigemptyset(&childSignal);
+    sigaddset(&childSignal, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &childSignal, &oldMask);
+
+    long long start = traceTime();
+    long long deadline = start + (long long)killGrace * 1000;
+    int remaining = signalChildren(head, SIGTERM);
+    int total = remaining;
+
+    while (remaining > 0)
+    {
+        pid_t id = waitpid(-1, &childStatus, escalated ? 0 : WNOHANG);
+        if (id == -1)
+            break;
+        if (id == 0)
+        {
+            // nobody has ended yet: sleep until one does, or time is up
+            long long left = deadline - traceTime();
+            if (left <= 0)
+            {
+                signalChildren(head, SIGKILL);
+                escalated = true;
+                continue;
+            }
+            struct timespec timeout = { left / 1000000,
+                (left % 1000000) * 1000 };
+            sigtimedwait(&childSignal, NULL, &timeout);
+            continue;
+        }
+
+        // only count processes from the linked list
+        struct childProc *current = head;
+        while (current != NULL && current->id != id)
+            current = current->next;
+        if (current == NULL)
+            continue;
+        traceEvent("background", current->id, current->line,
+                current->start, traceTime());
+        if (WIFEXITED(childStatus))
+            exited++;
+        else if (escalated && WTERMSIG(childStatus) == SIGKILL)
+            killed++;
+        else
+            terminated++;
+        head = removeChildProc(head, id);
+        remaining--;
+    }
+    freeChildren(head);
+    sigprocmask(SIG_SETMASK, &oldMask, NULL);
+
+    if (total > 0)
+    {
+        printf("stopped %d background processes in %lld ms: %d exited, "
+                "%d terminated, %d killed\n", total,
+                (traceTime() - start) / 1000, exited, terminated, killed);
+        fflush(stdout);
+    }
+    return;
+}
+
+/* builtIn *******************************************************************\
+ * builtIn looks at input words and checks to see the command was a
+ *  comment or one of the built-in commands: `cd, `exit`, `status`, `trace`,
+ *  and `ulimit`.
+ * Accepts:
+ *  head (struct argument *): Memory location of first word in user input
+ *  children (struct childProc *): Location of first childProc
+ *  exitStatus (struct endStatus *): Location of struct endStatus, for use
+ *      by `status` command.
+ *  result (struct endStatus *): Location to store whether the built-in
+ *      succeeded (exit value 0) or failed (exit value 1)
+ * Returns:
+ *  True if the command was a built-in.  False, otherwise.
+ *****************************************************************************/
+bool builtIn(struct argument *head, struct childProc *children, 
+        struct endStatus *exitStatus, struct endStatus *result)
+{
+    result->exit = true;
+    result->num = 0;
+    result->limit = NULL;
+    if (! strcmp("exit", head->text))
+    {
+        killChildren(children);
+        traceStop();
+        freeArguments(head);
+        free(exitStatus);
+        exit(EXIT_SUCCESS);
+        return true;
+    }
+    if (! strcmp("cd", head->text))
+    {
+        result->num = ! changeDir(head);
+        return true;
+    }
+    if (! strcmp("status", head->text))
+    {
+        printStatus(exitStatus);
+        return true;
+    }
+    if (! strcmp("trace", head->text))
+    {
+        struct argument *mode = head->next;
+        if (mode != NULL && ! strcmp(mode->text, "on"))
+        {
+            if (mode->next != NULL)
+                result->num = ! traceStart(mode->next->text);
+            else
+                result->num = ! traceStart(trace.path ? trace.path
+                        : TRACE_DEFAULT);
+        }
+        else if (mode != NULL && ! strcmp(mode->text, "off"))
+            traceStop();
+        else
+        {
+            fprintf(stderr, "usage: trace on [file] | trace off\n");
+            fflush(stderr);
+            result->num = 1;
+        }
+        return true;
+    }
+    if (! strcmp("ulimit", head->text))
+    {
+        // Only change the shell's limits if every setting is valid
+        struct limits newLimits = shellLimits;
+        struct argument *current = head->next;
+        if (current == NULL)
+            printLimits(&shellLimits);
+        while (current != NULL && parseLimit(current->text, &newLimits))
+            current = current->next;
+        if (current == NULL)
+            shellLimits = newLimits;
+        else
+            result->num = 1;
+        return true;
+    }
+
+    return false;
+}
+
+/* runCommand ****************************************************************\
+ * RunCommand runs one command of a list: a built-in command, `wait`,
+ *  `watch`, or any other process.
+ * Accepts:
+ *  head (struct argument *): Location of first argument
+ *  children (struct childProc *): Location of children processes linked list
+ *  exitStatus (struct endStatus *): Location of endStatus struct.  For
+ *      storing information needed by`status` built-in command
+ *  result (struct endStatus *): Location to store how the command ended (a
+ *      background process counts as exit value 0)
+ *  SIGINT_action (struct sigaction): Struct for handling SIGINT
+ *  SIGTSTP_action (struct sigaction): Struct for handling SIGTSTP
+ * Returns:
+ *  head of linked list of childProc
+ *****************************************************************************/
+struct childProc *runCommand(struct argument *head,
+        struct childProc *children, struct endStatus *exitStatus,
+        struct endStatus *result, struct sigaction SIGINT_action,
+        struct sigaction SIGTSTP_action)
+{
+    // Check against built-in functions: cd, exit, status, trace, ulimit
+    if (builtIn(head, children, exitStatus, result))
+        return children;
+
+    // `wait` needs to update the children processes linked list
+    if (! strcmp("wait", head->text))
+        children = waitChildren(children);
+    // `watch` runs the command through `otherProcess`, like any other
+    else if (! strcmp("watch", head->text))
+        children = watchCommand(head, children, exitStatus, result,
+                SIGINT_action, SIGTSTP_action);
+    // Run fork and execute other processes
+    else
+    {
+        children = otherProcess(head, children, exitStatus, SIGINT_action,
+                SIGTSTP_action);
+        if (! head->background)
+            *result = *exitStatus;
+    }
+    return children;
+}
+
+/* runList *******************************************************************\
+ * RunList runs a list of commands joined by `;`, `&&` and `||`.  After `&&`
+ *  the next command only runs if the last one that ran succeeded, and after
+ *  `||` only if it failed.  The list stops if a foreground process is ended
+ *  by SIGINT.
+ * Accepts:
+ *  head (struct argument *): Location of first command's first argument
+ *  children (struct childProc *): Location of children processes linked list
+ *  exitStatus (struct endStatus *): Location of endStatus struct.  For
+ *      storing information needed by`status` built-in command
+ *  result (struct endStatus *): Location to store how the last command that
+ *      ran ended
+ *  SIGINT_action (struct sigaction): Struct for handling SIGINT
+ *  SIGTSTP_action (struct sigaction): Struct for handling SIGTSTP
+ * Returns:
+ *  head of linked list of childProc
+ *****************************************************************************/
+struct childProc *runList(struct argument *head, struct childProc *children,
+        struct endStatus *exitStatus, struct endStatus *result,
+        struct sigaction SIGINT_action, struct sigaction SIGTSTP_action)
+{
+    struct argument *command = head;
+    char connector = ';';                   // connector before `command`
+
+    result->exit = true;
+    result->num = 0;
+    result->limit = NULL;
+    while (command != NULL)
+    {
+        bool succeeded = result->exit && result->num == 0;
+        if (connector == ';' || (connector == '&' && succeeded)
+                || (connector == '|' && ! succeeded))
+        {
+            children = runCommand(command, children, exitStatus, result,
+                    SIGINT_action, SIGTSTP_action);
+            if (! result->exit && result->num == SIGINT)
+                break;
+        }
+        connector = command->connector;
+        command = command->nextCommand;
+    }
+    return children;
+}
+
+/* spawnList *****************************************************************\
+ * SpawnList starts a subshell that runs a list of commands, without waiting
+ *  for it.  Used by parallel (`-P`) mode, so the list runs as one line.  The
+ *  subshell ends the way the last command that ran ended.
+ * Accepts:
+ *  head (struct argument *): Location of first command's first argument
+ *  SIGINT_action (struct sigaction): Struct for handling SIGINT
+ *  SIGTSTP_action (struct sigaction): Struct for handling SIGTSTP
+ * Returns:
+ *  <pid> of the subshell
+ *****************************************************************************/
+pid_t spawnList(struct argument *head, struct sigaction SIGINT_action,
+        struct sigaction SIGTSTP_action)
+{
+    struct endStatus exitStatus = { true, 0, NULL };
+    struct endStatus result;
+
+    pid_t newID = fork();
+    switch (newID)
+    {
+        case -1:
+            // Error forking
+            perror("fork()\n");
+            exit(1);
+            break;
+        case 0:
+            // Subshell: the trace file and spawn helper belong to the shell
+            if (trace.fd != -1)
+                close(trace.fd);
+            trace.fd = -1;
+            if (spawnHelper != -1)
+                close(spawnHelper);
+            spawnHelper = -1;
+            runList(head, NULL, &exitStatus, &result, SIGINT_action,
+                    SIGTSTP_action);
+            if (result.exit)
+                exit(result.num);
+            signal(result.num, SIG_DFL);
+            raise(result.num);
+            exit(1);
+        default:
+            break;
+    }
+    return newID;
+}
+
+/* makeArgument **************************************************************\
+ * MakeArgument takes a word (space-separated part of user input), and creates
+ *  an `argument` struct.  This allows for a linked list of words for program
+ *  use.
+ * Accepts:
+ *  token (char *): Memory location of word
+ * Returns:
+ *  struct argument *: Memoory location of argument struct
+ *****************************************************************************/
+struct argument *makeArgument(char *token)
+{
+    struct argument *thisWord = malloc(sizeof(struct argument));
+
+    thisWord->text = calloc(strlen(token) + 1, sizeof(char));
+    strcpy(thisWord->text, token);
+    thisWord->redirInput = NULL;
+    thisWord->redirOutput = NULL;
+    thisWord->appendOutput = false;
+    thisWord->redirError = NULL;
+    thisWord->appendError = false;
+    thisWord->errorToOutput = false;
+    thisWord->background = false;
+    thisWord->line = lineNumber;
+    thisWord->limits = NULL;
+    thisWord->hereFD = -1;
+    thisWord->hereDelim = NULL;
+    thisWord->connector = '\0';
+    thisWord->nextCommand = NULL;
+    thisWord->position = -1;
+    thisWord->next = NULL;
+    
+    return thisWord;
+}
+
+/* nextWord ******************************************************************\
+ * NextWord finds the next space-separated word in the user input, and ends
+ *  it with a terminator.  When `quoted` is set, a word starting with `"` or
+ *  `'` runs to the matching quote (spaces included), without the quotes.
+ * Accepts:
+ *  cursor (char **): Location of current position within input
+ *  quoted (bool): Whether the word may be quoted
+ * Returns:
+ *  Next word, or NULL if there are no more
+ *****************************************************************************/
+char *nextWord(char **cursor, bool quoted)
+{
+    char *word;
+    char *end;
+
+    while (**cursor == ' ')
+        (*cursor)++;
+    if (**cursor == '\0')
+        return NULL;
+
+    if (quoted && (**cursor == '"' || **cursor == '\''))
+    {
+        word = *cursor + 1;
+        end = strchr(word, **cursor);
+        if (end == NULL)
+            end = word + strlen(word);
+    }
+    else
+    {
+        word = *cursor;
+        end = word + strcspn(word, " ");
+    }
+    *cursor = *end == '\0' ? end : end + 1;
+    *end = '\0';
+    return word;
+}
+
+/* listConnector *************************************************************\
+ * ListConnector checks whether a word joins two commands of a list.
+ * Accepts:
+ *  word (char *): Word of user input
+ * Returns:
+ *  `;` for `;`, `&` for `&&`, `|` for `||`, or `\0` for any other word
+ *****************************************************************************/
+char listConnector(char *word)
+{
+    if (! strcmp(word, ";"))
+        return ';';
+    if (! strcmp(word, "&&"))
+        return '&';
+    if (! strcmp(word, "||"))
+        return '|';
+    return '\0';
+}
+
+/* parseCommand **************************************************************\
+ * ParseCommand removes the `limit` prefix, background and IO redirection
+ *  words from the linked list of one command's words, and records them in
+ *  the head.
+ * Accepts:
+ *  head (struct argument *): Location of head of linked list
+ * Returns:
+ *  New head of linked list (NULL, with list freed, if `limit` prefix or a
+ *      redirection was bad)
+ *****************************************************************************/
+struct argument *parseCommand(struct argument *head)
+{
+    struct argument *tail;
+    int counter = 0;
+
+    // Check for `limit` prefix
+    if ( ! strcmp(head->text, "limit"))
+    {
+        head = setLimits(head);
+        if (head == NULL)
+            return head;
+    }
+    for (tail = head; tail->next != NULL; tail = tail->next)
+        ;
+    // Check for background task
+    if ( ! strcmp(tail->text, "&"))
+            setBackground(head);
+
+    // Look for IO redirection, anywhere after the command
+    if ( ! redirectIO(head))
+    {
+        freeArguments(head);
+        return NULL;
+    }
+    for (tail = head; tail != NULL; tail = tail->next)
+        tail->position = counter++;
+
+    return head;
+}
+
+/* separateInput *************************************************************\
+ * SeparateInput takes the line of user input and separates it into a linked
+ *  list of char * tokens, separated by space (the word after `<<<` may be
+ *  quoted).  The words are then split into a list of commands at each `;`,
+ *  `&&` and `||`, linked through `nextCommand`, and each command is passed
+ *  to `parseCommand`.
+ * Accepts:
+ *  input (char *): Pointer to user input
+ * Returns:
+ *  Head of first command of list (NULL if there are no words, too many
+ *      words, a command is missing, or a `limit` prefix was bad)
+ *****************************************************************************/
+struct argument *separateInput(char *input)
+{
+    struct argument *head = NULL;
+    struct argument *tail = NULL;
+    int counter = 0;
+    char *token = nextWord(&input, false);
+    
+    while (token != NULL)
+    {
+        // leave room for the NULL that ends `execvp`'s array
+        if (counter == MAX_ARGUMENTS - 1)
+        {
+            fprintf(stderr, "smallsh: too many arguments (at most %d)\n",
+                    MAX_ARGUMENTS - 1);
+            freeArguments(head);
+            return NULL;
+        }
+        struct argument *thisWord = makeArgument(token);
+        if (head == NULL)
+        {
+            head = thisWord;
+            tail = thisWord;
+        }
+        else
+        {
+            tail->next = thisWord;
+            tail = thisWord;
+        }
+        thisWord->position = counter++;
+        token = nextWord(&input, ! strcmp(thisWord->text, "<<<"));
+    }
+    // Check for a line of nothing but spaces
+    if (head == NULL)
+        return head;
+
+    // Split into commands, at each connector (except a here-string's word)
+    struct argument *first = NULL;          // first command of list
+    struct argument *last = NULL;           // last command found so far
+    struct argument *current = head;
+    while (current != NULL)
+    {
+        struct argument *command = current;
+        struct argument *previous = NULL;
+        while (current != NULL && (listConnector(current->text) == '\0'
+                    || (previous != NULL && ! strcmp(previous->text, "<<<"))))
+        {
+            previous = current;
+            current = current->next;
+        }
+        char connector = '\0';
+        if (current != NULL)
+        {
+            connector = listConnector(current->text);
+            // a connector needs a command before it, and `&&` and `||`
+            //  need one after
+            if (previous == NULL || (connector != ';' && current->next == NULL))
+            {
+                fprintf(stderr, "smallsh: syntax error near `%s'\n",
+                        current->text);
+                freeArguments(first);
+                freeArguments(command);
+                return NULL;
+            }
+            previous->next = NULL;
+            struct argument *joiner = current;
+            current = current->next;
+            joiner->next = NULL;
+            freeArguments(joiner);
+        }
+
+        command = parseCommand(command);
+        if (command == NULL)
+        {
+            freeArguments(first);
+            freeArguments(current);
+            return NULL;
+        }
+        command->connector = connector;
+        if (first == NULL)
+            first = command;
+        else
+            last->nextCommand = command;
+        last = command;
+    }
+
+    return first;
+}
+ 
+/* trieInsert ****************************************************************\
+ * TrieInsert adds a command name to the trie of commands on PATH.
+ * Accepts:
+ *  node (struct trieNode **): Location of pointer to first node of a level
+ *  name (char *): Rest of command name to add
+ *  bit (unsigned long long): Bit for the PATH directory holding the command
+ * Returns:
+ *  Nothing
+ *****************************************************************************/
+void trieInsert(struct trieNode **node, char *name, unsigned long long bit)
+{
+    while (*name != '\0')
+    {
+        // siblings are kept in order, so listings come out sorted
+        while (*node != NULL && (*node)->c < *name)
+            node = &(*node)->sibling;
+        if (*node == NULL || (*node)->c != *name)
+        {
+            struct trieNode *thisNode = calloc(1, sizeof(struct trieNode));
+            thisNode->c = *name;
+            thisNode->sibling = *node;
+            *node = thisNode;
+        }
+        if (*++name == '\0')
+            (*node)->dirs |= bit;
+        else
+            node = &(*node)->child;
+    }
+    return;
+}
+
+/* trieClear *****************************************************************\
+ * TrieClear removes a PATH directory's bit from every node of the trie, and
+ *  frees nodes that no longer lead to any command.
+ * Accepts:
+ *  node (struct trieNode **): Location of pointer to first node of a level
+ *  mask (unsigned long long): Bits to remove (all bits frees the trie)
+ * Returns:
+ *  Nothing
+ *****************************************************************************/
+void trieClear(struct trieNode **node, unsigned long long mask)
+{
+    while (*node != NULL)
+    {
+        struct trieNode *current = *node;
+        trieClear(&current->child, mask);
+        current->dirs &= ~mask;
+        if (current->dirs == 0 && current->child == NULL)
+        {
+            *node = current->sibling;
+            free(current);
+        }
+        else
+            node = &current->sibling;
+    }
+    return;
+}
+
+/* trieCollect ***************************************************************\
+ * TrieCollect adds every command below a trie node to a completion.
+ * Accepts:
+ *  node (struct trieNode *): First node of a level
+ *  name (char *): Buffer holding the command name so far
+ *  length (int): Length of command name so far
+ *  found (struct completion *): Location of completion to add to
+ * Returns:
+ *  Nothing
+ *****************************************************************************/
+void trieCollect(struct trieNode *node, char *name, int length,
+        struct completion *found)
+{
+    for (; node != NULL && length < LINE_LENGTH - 1; node = node->sibling)
+    {
+        name[length] = node->c;
+        name[length + 1] = '\0';
+        if (node->dirs != 0)
+            addCompletion(found, name, false);
+        trieCollect(node->child, name, length + 1, found);
+    }
+    return;
+}
+
+/* scanPathDir ***************************************************************\
+ * ScanPathDir adds every executable in one PATH directory to the trie.
+ * Accepts:
+ *  index (int): Index of directory within `commands.dirs`
+ * Returns:
+ *  Nothing
+ *****************************************************************************/
+void scanPathDir(int index)
+{
+    unsigned long long bit = 1ULL << (index < 63 ? index : 63);
+    struct stat info;
+
+    DIR *dir = opendir(commands.dirs[index]);
+    if (dir == NULL)
+        return;
+    if (fstat(dirfd(dir), &info) == 0)
+        commands.mtimes[index] = info.st_mtim;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL)
+    {
+        if (entry->d_name[0] == '.' || entry->d_type == DT_DIR)
+            continue;
+        if (faccessat(dirfd(dir), entry->d_name, X_OK, 0) == 0)
+            trieInsert(&commands.root, entry->d_name, bit);
+    }
+    closedir(dir);
+    return;
+}
+
+/* indexPath *****************************************************************\
+ * IndexPath brings the trie of commands on PATH up to date.  The first call
+ *  (or a change to PATH) scans every directory; later calls only rescan
+ *  directories whose modification time has changed.  Directories past the
+ *  64th share one bit, so they are rescanned together.
+ * Accepts:
+ *  Nothing
+ * Returns:
+ *  Nothing
+ *****************************************************************************/
+void indexPath(void)
+{
+    char *path = getenv("PATH");
+    struct stat info;
+    bool sharedChanged = false;
+
+    if (path == NULL)
+        path = "";
+    if (commands.path == NULL || strcmp(commands.path, path))
+    {
+        // PATH itself changed, so start over
+        trieClear(&commands.root, ~0ULL);
+        for (int i = 0; i < commands.dirCount; i++)
+            free(commands.dirs[i]);
+        free(commands.dirs);
+        free(commands.mtimes);
+        free(commands.path);
+        commands.path = calloc(strlen(path) + 1, sizeof(char));
+        strcpy(commands.path, path);
+        commands.dirCount = 1;
+        for (char *c = path; *c != '\0'; c++)
+            commands.dirCount += *c == ':';
+        commands.dirs = calloc(commands.dirCount, sizeof(char *));
+        commands.mtimes = calloc(commands.dirCount, sizeof(struct timespec));
+
+        char *copy = calloc(strlen(path) + 1, sizeof(char));
+        strcpy(copy, path);
+        char *saveptr;
+        char *token = strtok_r(copy, ":", &saveptr);
+        commands.dirCount = 0;
+        while (token != NULL)
+        {
+            commands.dirs[commands.dirCount] =
+                calloc(strlen(token) + 1, sizeof(char));
+            strcpy(commands.dirs[commands.dirCount], token);
+            scanPathDir(commands.dirCount++);
+            token = strtok_r(NULL, ":", &saveptr);
+        }
+        free(copy);
+        return;
+    }
+
+    for (int i = 0; i < commands.dirCount; i++)
+    {
+        if (stat(commands.dirs[i], &info) == -1
+                || (info.st_mtim.tv_sec == commands.mtimes[i].tv_sec
+                    && info.st_mtim.tv_nsec == commands.mtimes[i].tv_nsec))
+            continue;
+        if (i >= 63)
+            sharedChanged = true;
+        else
+        {
+            trieClear(&commands.root, 1ULL << i);
+            scanPathDir(i);
+        }
+    }
+    if (sharedChanged)
+    {
+        trieClear(&commands.root, 1ULL << 63);
+        for (int i = 63; i < commands.dirCount; i++)
+            scanPathDir(i);
+    }
+    return;
+}
+
+/* addCompletion *************************************************************\
+ * AddCompletion adds one match to a completion, keeping the text that every
+ *  match starts with up to date.  Only the first COMPLETION_LIST matches are
+ *  kept for listing.
+ * Accepts:
+ *  found (struct completion *): Location of completion to add to
+ *  name (char *): Matching name
+ *  directory (bool): Whether the match is a directory
+ * Returns:
+ *  Nothing
+ *****************************************************************************/
+void addCompletion(struct completion *found, char *name, bool directory)
+{
+    if (found->count == 0)
+    {
+        strncpy(found->common, name, LINE_LENGTH - 1);
+        found->common[LINE_LENGTH - 1] = '\0';
+    }
+    else
+    {
+        int i = 0;
+        while (found->common[i] != '\0' && found->common[i] == name[i])
+            i++;
+        found->common[i] = '\0';
+    }
+    if (found->count < COMPLETION_LIST)
+    {
+        found->names[found->count] = calloc(strlen(name) + 1, sizeof(char));
+        strcpy(found->names[found->count], name);
+    }
+    found->directory = directory;
+    found->count++;
+    return;
+}
+
+/* completeCommand ***********************************************************\
+ * CompleteCommand finds the commands on PATH that start with a prefix.
+ * Accepts:
+ *  prefix (char *): Start of command name
+ *  found (struct completion *): Location of completion to fill
+ * Returns:
+ *  Nothing
+ *****************************************************************************/
+void completeCommand(char *prefix, struct completion *found)
+{
+    char name[LINE_LENGTH];
+    struct trieNode *level;
+    struct trieNode *node = NULL;
+    int length = strlen(prefix);
+
+    // Rescanning can free nodes, so the root is read afterwards
+    indexPath();
+    level = commands.root;
+    // Walk down to the node for the last character of the prefix
+    for (int i = 0; i < length; i++)
+    {
+        node = level;
+        while (node != NULL && node->c != prefix[i])
+            node = node->sibling;
+        if (node == NULL)
+            return;
+        level = node->child;
+    }
+    strcpy(name, prefix);
+    if (node != NULL && node->dirs != 0)
+        addCompletion(found, name, false);
+    trieCollect(level, name, length, found);
+    return;
+}
+
+/* completeFile **************************************************************\
+ * CompleteFile finds the directory entries that start with a prefix.  The
+ *  directory is only listed when a completion is asked for.
+ * Accepts:
+ *  word (char *): Filepath typed so far
+ *  found (struct completion *): Location of completion to fill
+ * Returns:
+ *  Base name typed so far (within `word`)
+ *****************************************************************************/
+char *completeFile(char *word, struct completion *found)
+{
+    char dirPath[LINE_LENGTH];
+    char *base = strrchr(word, '/');
+    struct stat info;
+
+    if (base == NULL)
+    {
+        strcpy(dirPath, ".");
+        base = word;
+    }
+    else
+    {
+        snprintf(dirPath, LINE_LENGTH, "%.*s", (int)(base - word + 1), word);
+        base++;
+    }
+
+    DIR *dir = opendir(dirPath);
+    if (dir == NULL)
+        return base;
+    struct dirent *entry;
+    int length = strlen(base);
+    while ((entry = readdir(dir)) != NULL)
+    {
+        // hidden entries are only offered when asked for
+        if (strncmp(entry->d_name, base, length)
+                || (entry->d_name[0] == '.' && base[0] != '.')
+                || ! strcmp(entry->d_name, ".")
+                || ! strcmp(entry->d_name, ".."))
+            continue;
+        bool directory = entry->d_type == DT_DIR;
+        if (entry->d_type == DT_LNK || entry->d_type == DT_UNKNOWN)
+            directory = fstatat(dirfd(dir), entry->d_name, &info, 0) == 0
+                && S_ISDIR(info.st_mode);
+        addCompletion(found, entry->d_name, directory);
+    }
+    closedir(dir);
+    return base;
+}
+
+/* refreshLine ***************************************************************\
+ * RefreshLine redraws the prompt and line being edited, and puts the cursor
+ *  back in place.
+ * Accepts:
+ *  prompt (char *): Prompt to show
+ *  line (char *): Line being edited
+ *  cursor (int): Location of cursor within line
+ * Returns:
+ *  Nothing
+ *****************************************************************************/
+void refreshLine(char *prompt, char *line, int cursor)
+{
+    char output[LINE_LENGTH * 2];
+    int length = snprintf(output, sizeof(output), "\r%s%s\x1b[K", prompt,
+            line);
+    int back = strlen(line) - cursor;
+    if (back > 0)
+        length += snprintf(output + length, sizeof(output) - length,
+                "\x1b[%dD", back);
+    write(STDOUT_FILENO, output, length);
+    return;
+}
+
+/* completeLine **************************************************************\
+ * CompleteLine completes the word before the cursor: the first word from the
+ *  commands on PATH, any other word (or one with a `/`) from the files in
+ *  its directory.  When nothing can be added and `list` is set, the
+ *  matches are printed.
+ * Accepts:
+ *  prompt (char *): Prompt being shown
+ *  line (char *): Line being edited
+ *  cursor (int *): Location of cursor within line
+ *  list (bool): Whether to print the matches if nothing can be added
+ * Returns:
+ *  Nothing
+ *****************************************************************************/
+void completeLine(char *prompt, char *line, int *cursor, bool list)
+{
+    char word[LINE_LENGTH];
+    struct completion found;
+    char *typed;                        // part of word the matches start with
+    int start = *cursor;
+
+    while (start > 0 && line[start - 1] != ' ')
+        start--;
+    snprintf(word, LINE_LENGTH, "%.*s", *cursor - start, line + start);
+    found.count = 0;
+    found.directory = false;
+
+    bool command = strchr(word, '/') == NULL;
+    for (int i = 0; command && i < start; i++)
+        command = line[i] == ' ';
+    if (command)
+    {
+        completeCommand(word, &found);
+        typed = word;
+    }
+    else
+        typed = completeFile(word, &found);
+
+    // Text to add: rest of the common start, then an ending if only one match
+    char insert[LINE_LENGTH];
+    int length = snprintf(insert, LINE_LENGTH, "%s",
+            found.count > 0 ? found.common + strlen(typed) : "");
+    if (found.count == 1 && length < LINE_LENGTH - 1)
+        insert[length++] = found.directory ? '/' : ' ';
+    insert[length] = '\0';
+
+    int lineLength = strlen(line);
+    if (length > 0 && lineLength + length < LINE_LENGTH)
+    {
+        memmove(line + *cursor + length, line + *cursor,
+                lineLength - *cursor + 1);
+        memcpy(line + *cursor, insert, length);
+        *cursor += length;
+    }
+    else if (list && found.count > 1)
+    {
+        printf("\r\n");
+        for (int i = 0; i < found.count && i < COMPLETION_LIST; i++)
+            printf("%s  ", found.names[i]);
+        if (found.count > COMPLETION_LIST)
+            printf("(%d more)", found.count - COMPLETION_LIST);
+        printf("\r\n");
+        fflush(stdout);
+    }
+    for (int i = 0; i < found.count && i < COMPLETION_LIST; i++)
+        free(found.names[i]);
+    refreshLine(prompt, line, *cursor);
+    return;
+}
+
+/* addHistory ****************************************************************\
+ * AddHistory adds a line to the history, dropping the oldest line when full.
+ *  Blank lines and repeats of the last line are not added.
+ * Accepts:
+ *  line (char *): Line to add
+ * Returns:
+ *  Nothing
+ *****************************************************************************/
+void addHistory(char *line)
+{
+    if (line[0] == '\0' || (history.count > 0
+                && ! strcmp(history.lines[history.count - 1], line)))
+        return;
+    if (history.count == HISTORY_LENGTH)
+    {
+        free(history.lines[0]);
+        memmove(history.lines, history.lines + 1,
+                (HISTORY_LENGTH - 1) * sizeof(char *));
+        history.count--;
+    }
+    history.lines[history.count] = calloc(strlen(line) + 1, sizeof(char));
+    strcpy(history.lines[history.count++], line);
+    return;
+}
+
+/* editLine ******************************************************************\
+ * EditLine reads a line from the terminal in raw mode, with cursor movement
+ *  (arrows, Home/End, Ctrl-A/E/B/F), deleting (Backspace, Delete, Ctrl-U/K),
+ *  history recall (Up/Down, Ctrl-P/N) and Tab completion.  The terminal is
+ *  only in raw mode while the line is being read.
+ * Accepts:
+ *  prompt (char *): Prompt to show
+ *  line (char *): Buffer of LINE_LENGTH to fill
+ * Returns:
+ *  False if input has ended (Ctrl-D on empty line).  True, otherwise.
+ *****************************************************************************/
+bool editLine(char *prompt, char *line)
+{
+    struct termios cooked;
+    struct termios raw;
+    char saved[LINE_LENGTH] = "";       // line being typed, while in history
+    int recall = history.count;         // history line shown
+    int cursor = 0;
+    int length;
+    bool lastTab = false;
+    bool more = true;
+    bool finished = false;
+    unsigned char c;
+    unsigned char sequence[16];
+    int size;
+    int key;
+
+    tcgetattr(STDIN_FILENO, &cooked);
+    raw = cooked;
+    raw.c_iflag &= ~(ICRNL | IXON);
+    raw.c_lflag &= ~(ICANON | ECHO | IEXTEN);
+    raw.c_cc[VMIN] = 1;
+    raw.c_cc[VTIME] = 0;
+    tcsetattr(STDIN_FILENO, TCSANOW, &raw);
+
+    line[0] = '\0';
+    refreshLine(prompt, line, cursor);
+    while (! finished)
+    {
+        if (read(STDIN_FILENO, &c, 1) != 1)
+        {
+            more = line[0] != '\0';
+            break;
+        }
+        length = strlen(line);
+        key = c;
+        if (c == '\r' || c == '\n')
+            break;
+        if (c == '\t')
+        {
+            completeLine(prompt, line, &cursor, lastTab);
+            lastTab = true;
+            continue;
+        }
+        lastTab = false;
+
+        // Turn escape sequences into the matching control keys.  Their
+        //  bytes may arrive in separate reads, so they are read one at a
+        //  time: `ESC O` takes one more byte, and `ESC [` runs up to its
+        //  final byte (`@` to `~`).
+        if (c == 27)
+        {
+            if (read(STDIN_FILENO, sequence, 1) != 1)
+                continue;
+            size = 1;
+            while ((sequence[0] == 'O' && size < 2)
+                    || (sequence[0] == '[' && size < (int)sizeof(sequence)
+                        && (size == 1 || sequence[size - 1] < '@'
+                            || sequence[size - 1] > '~')))
+            {
+                if (read(STDIN_FILENO, sequence + size, 1) != 1)
+                    break;
+                size++;
+            }
+            if (size < 2)
+                continue;
+            if (sequence[0] == '[' && sequence[1] >= '0'
+                    && sequence[1] <= '9')
+            {
+                if (size != 3 || sequence[2] != '~')
+                    continue;
+                key = sequence[1] == '3' ? KEY_DELETE
+                    : (sequence[1] == '1' || sequence[1] == '7') ? 1
+                    : (sequence[1] == '4' || sequence[1] == '8') ? 5 : 0;
+            }
+            else if (sequence[0] == '[' || sequence[0] == 'O')
+            {
+                key = sequence[1] == 'A' ? 16 : sequence[1] == 'B' ? 14
+                    : sequence[1] == 'C' ? 6 : sequence[1] == 'D' ? 2
+                    : sequence[1] == 'H' ? 1 : sequence[1] == 'F' ? 5 : 0;
+            }
+            else
+                continue;
+        }
+
+        switch (key)
+        {
+            case 1:                     // Ctrl-A, Home
+                cursor = 0;
+                break;
+            case 2:                     // Ctrl-B, Left
+                if (cursor > 0)
+                    cursor--;
+                break;
+            case 4:                     // Ctrl-D: end of input, or Delete
+                if (length == 0)
+                {
+                    more = false;
+                    finished = true;
+                    break;
+                }
+                /* FALLTHROUGH */
+            case KEY_DELETE:            // Delete
+                if (cursor < length)
+                    memmove(line + cursor, line + cursor + 1,
+                            length - cursor);
+                break;
+            case 5:                     // Ctrl-E, End
+                cursor = length;
+                break;
+            case 6:                     // Ctrl-F, Right
+                if (cursor < length)
+                    cursor++;
+                break;
+            case 8:                     // Ctrl-H, Backspace
+            case 127:
+                if (cursor > 0)
+                {
+                    memmove(line + cursor - 1, line + cursor,
+                            length - cursor + 1);
+                    cursor--;
+                }
+                break;
+            case 11:                    // Ctrl-K: delete to end
+                line[cursor] = '\0';
+                break;
+            case 21:                    // Ctrl-U: delete to start
+                memmove(line, line + cursor, length - cursor + 1);
+                cursor = 0;
+                break;
+            case 14:                    // Ctrl-N, Down
+            case 16:                    // Ctrl-P, Up
+                if (key == 16 && recall == 0)
+                    break;
+                if (key == 14 && recall == history.count)
+                    break;
+                if (recall == history.count)
+                    strcpy(saved, line);
+                recall += key == 16 ? -1 : 1;
+                strcpy(line, recall == history.count ? saved
+                        : history.lines[recall]);
+                cursor = strlen(line);
+                break;
+            default:
+                if (key < 32 || length >= LINE_LENGTH - 1)
+                    break;
+                memmove(line + cursor + 1, line + cursor,
+                        length - cursor + 1);
+                line[cursor++] = c;
+                break;
+        }
+        refreshLine(prompt, line, cursor);
+    }
+    write(STDOUT_FILENO, "\r\n", 2);
+    tcsetattr(STDIN_FILENO, TCSANOW, &cooked);
+    addHistory(line);
+    return more;
+}
+
+/* readLine ******************************************************************\
+ * ReadLine reads one line of input, without its newline.  A terminal on
+ *  stdin gets the line editor; otherwise the prompt is only shown when
+ *  reading from stdin.  Lines longer than LINE_LENGTH are cut short.
+ * Accepts:
+ *  stream (FILE *): Stream to read the line from
+ *  prompt (char *): Prompt to show
+ *  line (char *): Buffer of LINE_LENGTH to fill
+ * Returns:
+ *  False if input had already ended.  True, otherwise.
+ *****************************************************************************/
+bool readLine(FILE *stream, char *prompt, char *line)
+{
+    int c;
+    int i = 0;
+
+    if (stream == stdin && isatty(STDIN_FILENO))
+        return editLine(prompt, line);
+    if (stream == stdin)
+    {
+        printf("%s", prompt);
+        fflush(stdout);
+    }
+    while ((c = getc(stream)) != '\n' && c != EOF)
+    {
+        if (i < LINE_LENGTH - 1)
+            line[i++] = c;
+    }
+    line[i] = '\0';
+    return c != EOF || i > 0;
+}
+
+/* check$$ *******************************************************************\
+ * Check$$ looks for an instance of `$$` in the input, for variable expansion.
+ *  This should only be triggered after encountering the first instance of `$`.
+ *  Input is LINE_LENGTH long, and is never written past.
+ * Accepts:
+ *  line (char *): Line as it was read
+ *  r (int *): Location of current index within the line (at the `$`)
+ *  input (char *): Memory location of user input
+ *  i: Current index within the input
+ *  processID: Current PID
+ * Returns:
+ *  New index within the input (int), or -1 if the pid did not fit
+ *****************************************************************************/
+int check$$(char *line, int *r, char *input, int i, pid_t processID)
+{
+    // if next character is also `$`, we replace with pid
+    if (line[*r + 1] == '$')
+    {
+        int length = snprintf(input + i, LINE_LENGTH - i, "%d", processID);
+        if (i + length >= LINE_LENGTH)
+            return -1;
+        i += length;
+        *r += 2;
+    }
+
+    // if next character was not also `$`, we don't replace
+    else
+    {
+        input[i++] = '$';
+        *r += 1;
+    }
+    return i;
+}
+
+/* expandInput ***************************************************************\
+ * ExpandInput copies a line of input, replacing each `$$` with the pid.
+ * Accepts:
+ *  line (char *): Line as it was read
+ *  input (char *): Memory location (LINE_LENGTH long) to copy expanded line
+ *  processID (pid_t): ProcessID of current process
+ * Returns:
+ *  Length of expanded line (int), or -1 if it would not fit
+ *****************************************************************************/
+int expandInput(char *line, char *input, pid_t processID)
+{
+    int r = 0;                          // location within line
+    int i = 0;                          // location within input
+
+    while (line[r] != '\0' && i != -1)
+    {
+        if (i >= LINE_LENGTH - 1)
+            i = -1;
+        // if we got a `$`, check for $$ replacement
+        else if (line[r] == '$')
+            i = check$$(line, &r, input, i, processID);
+        // if we didn't get a `$`, append character to input
+        else
+            input[i++] = line[r++];
+    }
+    if (i == -1)
+    {
+        fprintf(stderr, "smallsh: line too long after $$ expansion\n");
+        input[0] = '\0';
+        return i;
+    }
+    input[i] = '\0';                    // make last character a terminator
+    return i;
+}
+
+/* parseLine *****************************************************************\
+ * ParseLine turns one line of input into a linked list of `argument` structs,
+ *  without reading anything more.  It does not depend on where the line came
+ *  from, so it can be benchmarked and fuzzed on its own.  Any here-document
+ *  body is left for the caller to read.
+ * Accepts:
+ *  line (char *): Line as it was read (without newline)
+ *  processID (pid_t): ProcessID of current process
+ * Returns:
+ *  Head of linked list of struct arguments (NULL if blank, comment, or bad)
+ *****************************************************************************/
+struct argument *parseLine(char *line, pid_t processID)
+{
+    char input[LINE_LENGTH];            // user input
+    struct argument *head = NULL;       // head of linked list for input
+
+    int i = expandInput(line, input, processID);
+    // if input was empty or comment, we return empty linked list 
+    if (i <= 0 || input[0] == '#')
+        return head;
+    // We now know input is neither empty nor commment, so we separate input
+    //  into words
+    long long start = traceTime();
+    head = separateInput(input);
+    traceEvent("parse", getpid(), lineNumber, start, traceTime());
+
+    return head;
+}
+
+/* getInput ******************************************************************\
+ * GetInput reads one line of input, and places it within a linked list of
+ *  `argument` structs.
+ * Accepts:
+ *  stream (FILE *): Stream to read the line from
+ *  processID (pid_t): ProcessID of current process
+ *  end (bool *): Location to store whether input has run out
+ * Returns:
+ *  Head of linked list of struct arguments (NULL if blank or comment)
+ *****************************************************************************/
+struct argument  *getInput(FILE *stream, pid_t processID, bool *end)
+{
+    char line[LINE_LENGTH];             // line as it was read
+    struct argument *head = NULL;       // head of linked list for input
+
+    // Get user input
+    *end = ! readLine(stream, ": ", line);
+    lineNumber++;
+    head = parseLine(line, processID);
+
+    // Read any here-documents that follow the line, in order
+    for (struct argument *command = head; command != NULL;
+            command = command->nextCommand)
+    {
+        if (command->hereDelim != NULL
+                && ! readHereDocument(stream, command, processID))
+        {
+            freeArguments(head);
+            head = NULL;
+            break;
+        }
+    }
+
+    return head;
+}
+
+/* checkTerminatedChildren ***************************************************\
+ * CheckTerminatedChildren goes through the linked list of children processes,
+ *  printing an appropriate termination message and cleaning up the linked list
+ *  when it finds one.
+ * Accepts:
+ *  head (struct childProc *): Location of first childProc
+ *  sig (bool): Whether or not this function was called by signal termination
+ * Returns:
+ *  head of linked list of childProcs 
+ *****************************************************************************/
+struct childProc *checkTerminatedChildren(struct childProc *head, bool sig)
+{
+    // if there are no child processes, return
+    if (head == NULL)
+        return head;
+
+    // if there are child processes, we iterate and look to see if anyone has
+    //  exited
+    struct childProc *current = head;
+    int childStatus;
+    int waitStatus;
+    while (current != NULL)
+    {
+        waitStatus = waitpid(current->id,&childStatus, WNOHANG);
+        if (waitStatus != 0)
+        {
+            // child process has terminated
+            traceEvent("background", current->id, current->line,
+                    current->start, traceTime());
+            if (WIFEXITED(childStatus))
+                printf("background pid %d is done: exit value %d\n", 
+                        waitStatus, WEXITSTATUS(childStatus));
+            else if (sig)
+                printf("terminated by signal %d\n", WTERMSIG(childStatus));
+            else
+                printf("background pid %d is done: terminated by signal %d\n",
+                        waitStatus, WTERMSIG(childStatus));
+            fflush(stdout);
+            current = current->next;
+            head = removeChildProc(head, waitStatus);
+        }
+        else
+            current = current->next;
+    }
+
+    return head;
+}
+
+/* checkForegroundOnly *******************************************************\
+ * CheckForegroundOnly checks to see if Foreground Only status has changed
+ *  since last run.
+ * Accepts:
+ *  Nothing
+ * Returns:
+ *  True if now in foreground only mode, false if not.
+ *****************************************************************************/
+bool checkForegroundOnly(bool lastTime)
+{
+    if (lastTime != backgroundOnly)
+    {
+        if (lastTime == false)
+        {
+            printf("Entering foreground-only mode (& is now ignored)\n");
+            return true;
+        }
+        else
+        {
+            printf("Exiting foreground-only mode\n");
+            return false;
+        }
+    }
+    return lastTime;
+}
+
+/* waitChildren **************************************************************\
+ * WaitChildren blocks until every process in the linked list of children
+ *  processes has ended, printing the same messages as
+ *  `checkTerminatedChildren`.  Used by the `wait` built-in command.
+ * Accepts:
+ *  head (struct childProc *): Location of first childProc
+ * Returns:
+ *  head of linked list of childProcs (always NULL)
+ *****************************************************************************/
+struct childProc *waitChildren(struct childProc *head)
+{
+    siginfo_t info;
+    while (head != NULL)
+    {
+        // wait without reaping, so `checkTerminatedChildren` can report it
+        if (waitid(P_PID, head->id, &info, WEXITED | WNOWAIT) == -1)
+            head = removeChildProc(head, head->id);
+        else
+            head = checkTerminatedChildren(head, false);
+    }
+    return head;
+}
+
+/* handle_SIGINT_watch *******************************************************\
+ * Handle_SIGINT_Watch notes that SIGINT arrived, so the `watch` built-in
+ *  command stops.
+ * Accepts:
+ *  sig (int): Signal number
+ * Returns:
+ *  Nothing
+ *****************************************************************************/
+void handle_SIGINT_watch(int sig)
+{
+    watchInterrupted = 1;
+}
+
+/* addWatch ******************************************************************\
+ * AddWatch starts watching a path with inotify.  A directory is watched
+ *  itself.  A file is watched through its directory, so that replacing the
+ *  file (as editors and `mv` do) is still seen.
+ * Accepts:
+ *  inotifyFD (int): inotify descriptor
+ *  path (char *): Filepath to watch
+ *  watched (struct watchedPath *): Location of watchedPath to fill
+ * Returns:
+ *  True if the path is being watched.  False, otherwise.
+ *****************************************************************************/
+bool addWatch(int inotifyFD, char *path, struct watchedPath *watched)
+{
+    char dirPath[LINE_LENGTH];
+    struct stat info;
+    uint32_t mask = IN_CLOSE_WRITE | IN_MODIFY | IN_CREATE | IN_DELETE
+        | IN_MOVED_TO | IN_MOVED_FROM | IN_ATTRIB;
+    char *slash = strrchr(path, '/');
+
+    watched->name = NULL;
+    if (stat(path, &info) == 0 && S_ISDIR(info.st_mode))
+        snprintf(dirPath, LINE_LENGTH, "%s", path);
+    else if (slash == NULL)
+    {
+        strcpy(dirPath, ".");
+        watched->name = path;
+    }
+    else
+    {
+        snprintf(dirPath, LINE_LENGTH, "%.*s",
+                slash == path ? 1 : (int)(slash - path), path);
+        watched->name = slash + 1;
+    }
+    watched->wd = inotify_add_watch(inotifyFD, dirPath, mask);
+    if (watched->wd == -1)
+    {
+        perror(path);
+        return false;
+    }
+    return true;
+}
+
+/* readWatchEvents ***********************************************************\
+ * ReadWatchEvents reads every waiting inotify event, and checks whether any
+ *  of them is for a watched path.  Changes to the command's own output and
+ *  error files are left out, so the command does not trigger itself.
+ * Accepts:
+ *  inotifyFD (int): inotify descriptor (non-blocking)
+ *  watched (struct watchedPath *): Array of watched paths
+ *  count (int): Number of watched paths
+ *  outputs (char *[]): Names of command's output and error files (NULL for
+ *      none)
+ * Returns:
+ *  True if a watched path changed.  False, otherwise.
+ *****************************************************************************/
+bool readWatchEvents(int inotifyFD, struct watchedPath *watched, int count,
+        char *outputs[])
+{
+    char buffer[4096]
+        __attribute__ ((aligned(__alignof__(struct inotify_event))));
+    bool changed = false;
+    ssize_t length;
+
+    while ((length = read(inotifyFD, buffer, sizeof(buffer))) > 0)
+    {
+        for (char *next = buffer; next < buffer + length;
+                next += sizeof(struct inotify_event)
+                + ((struct inotify_event *)next)->len)
+        {
+            struct inotify_event *event = (struct inotify_event *)next;
+            char *name = event->len > 0 ? event->name : "";
+            for (int i = 0; i < count; i++)
+            {
+                if (watched[i].wd != event->wd)
+                    continue;
+                if (watched[i].name == NULL ? ((outputs[0] == NULL
+                                || strcmp(name, outputs[0]))
+                            && (outputs[1] == NULL
+                                || strcmp(name, outputs[1])))
+                        : ! strcmp(name, watched[i].name))
+                    changed = true;
+            }
+        }
+    }
+    return changed;
+}
+
+/* watchCommand **************************************************************\
+ * WatchCommand runs the `watch [paths...] -- command` built-in command.  The
+ *  command runs once, then again each time a watched path changes: the
+ *  listed paths, plus the command's `<` input file.  Events arriving within
+ *  WATCH_DEBOUNCE milliseconds of each other count as one change.  SIGINT
+ *  stops watching.  A background (`&`) watch is refused.  A usage error,
+ *  nothing to watch, or no inotify instance fails the command.
+ * Accepts:
+ *  head (struct argument *): Location of first argument (`watch`)
+ *  children (struct childProc *): Location of children processes linked list
+ *  exitStatus (struct endStatus *): Location of endStatus struct.  For
+ *      storing information needed by`status` built-in command
+ *  result (struct endStatus *): Location to store how the watch ended
+ *  SIGINT_action (struct sigaction): Struct for handling SIGINT
+ *  SIGTSTP_action (struct sigaction): Struct for handling SIGTSTP
+ * Returns:
+ *  head of linked list of childProc
+ *****************************************************************************/
+struct childProc *watchCommand(struct argument *head,
+        struct childProc *children, struct endStatus *exitStatus,
+        struct endStatus *result, struct sigaction SIGINT_action,
+        struct sigaction SIGTSTP_action)
+{
+    struct argument *separator = head;
+    struct argument *previous = NULL;
+    while (separator != NULL && strcmp(separator->text, "--"))
+    {
+        previous = separator;
+        separator = separator->next;
+    }
+    if (separator == NULL || separator->next == NULL)
+    {
+        fprintf(stderr, "usage: watch [paths...] -- command [args]\n");
+        result->num = 1;
+        return children;
+    }
+    // Watching holds the prompt until SIGINT, so it cannot run in the
+    //  background
+    if (head->background)
+    {
+        fprintf(stderr, "watch: cannot run in the background (&)\n");
+        result->num = 1;
+        return children;
+    }
+
+    // Cut the command off, moving the line's redirection over to it
+    struct argument *command = separator->next;
+    separator->next = NULL;
+    previous->next = NULL;
+    freeArguments(separator);
+    command->redirInput = head->redirInput;
+    command->redirOutput = head->redirOutput;
+    command->appendOutput = head->appendOutput;
+    command->redirError = head->redirError;
+    command->appendError = head->appendError;
+    command->errorToOutput = head->errorToOutput;
+    command->hereFD = head->hereFD;
+    command->limits = head->limits;
+    command->line = head->line;
+    head->redirInput = head->redirOutput = head->redirError = NULL;
+    head->hereFD = -1;
+    head->limits = NULL;
+
+    int inotifyFD = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotifyFD == -1)
+    {
+        perror("watch");
+        freeArguments(command);
+        result->num = 1;
+        return children;
+    }
+    int count = 0;
+    int size = 1;                           // paths, plus `<` file
+    for (struct argument *path = head->next; path != NULL;
+            path = path->next)
+        size++;
+    struct watchedPath *watched = calloc(size, sizeof(struct watchedPath));
+    for (struct argument *path = head->next; path != NULL;
+            path = path->next)
+        count += addWatch(inotifyFD, path->text, &watched[count]);
+    if (command->redirInput != NULL)
+        count += addWatch(inotifyFD, command->redirInput, &watched[count]);
+    char *outputs[2] = { command->redirOutput, command->redirError };
+    for (int i = 0; i < 2; i++)
+    {
+        char *name = outputs[i] != NULL ? strrchr(outputs[i], '/') : NULL;
+        if (name != NULL)
+            outputs[i] = name + 1;
+    }
+
+    if (count == 0)
+    {
+        fprintf(stderr, "watch: nothing to watch\n");
+        result->num = 1;
+    }
+    else
+    {
+        // SIGINT stops watching (and ends the command, as for any
+        //  foreground process).  It stays blocked except inside `ppoll`,
+        //  so one arriving between the check and the wait is not lost;
+        //  `ppoll` is never restarted, so no SA_RESTART.
+        struct sigaction watchAction = SIGINT_action;
+        watchAction.sa_handler = handle_SIGINT_watch;
+        watchAction.sa_flags = 0;
+        sigset_t interrupt;
+        sigset_t oldMask;
+        sigset_t waitMask;
+        sigemptyset(&interrupt);
+        sigaddset(&interrupt, SIGINT);
+        sigprocmask(SIG_BLOCK, &interrupt, &oldMask);
+        waitMask = oldMask;
+        sigdelset(&waitMask, SIGINT);
+        watchInterrupted = 0;
+        sigaction(SIGINT, &watchAction, NULL);
+
+        struct pollfd events = { inotifyFD, POLLIN, 0 };
+        struct timespec debounce = { 0, WATCH_DEBOUNCE * 1000000L };
+        bool changed = true;
+        while (! watchInterrupted)
+        {
+            if (changed)
+                children = otherProcess(command, children, exitStatus,
+                        SIGINT_action, SIGTSTP_action);
+            changed = false;
+            if (ppoll(&events, 1, NULL, &waitMask) <= 0)
+                continue;
+            changed = readWatchEvents(inotifyFD, watched, count, outputs);
+            // wait for a quiet moment, so a burst of events is one change
+            while (! watchInterrupted
+                    && ppoll(&events, 1, &debounce, &waitMask) > 0)
+                changed |= readWatchEvents(inotifyFD, watched, count,
+                        outputs);
+        }
+        printf("\n");
+        fflush(stdout);
+        // ignore SIGINT again before unblocking, dropping any pending one
+        sigaction(SIGINT, &SIGINT_action, NULL);
+        sigprocmask(SIG_SETMASK, &oldMask, NULL);
+        *result = *exitStatus;
+    }
+
+    close(inotifyFD);
+    free(watched);
+    freeArguments(command);
+    return children;
+}
+
+/* readScript ****************************************************************\
+ * ReadScript reads every line of a script into an array of scriptLines.
+ * Accepts:
+ *  stream (FILE *): Stream the script is read from
+ *  processID (pid_t): ProcessID of current process, for `$$` expansion
+ *  count (int *): Location to store the number of lines read
+ * Returns:
+ *  Array of struct scriptLine (NULL if the script is empty)
+ *****************************************************************************/
+struct scriptLine *readScript(FILE *stream, pid_t processID, int *count)
+{
+    struct scriptLine *lines = NULL;
+    int capacity = 0;
+    *count = 0;
+
+    bool end = false;
+
+    while (true)
+    {
+        struct argument *head = getInput(stream, processID, &end);
+        if (end)
+            break;
+        if (*count == capacity)
+        {
+            capacity = capacity == 0 ? 64 : capacity * 2;
+            lines = realloc(lines, capacity * sizeof(struct scriptLine));
+        }
+        struct scriptLine *line = &lines[(*count)++];
+        line->number = head != NULL ? head->line : lineNumber;
+        line->head = head;
+        // a line is a barrier if any command in its list is
+        line->barrier = false;
+        for (struct argument *command = head; command != NULL;
+                command = command->nextCommand)
+            line->barrier |= ! strcmp(command->text, "wait")
+                || ! strcmp(command->text, "cd")
+                || ! strcmp(command->text, "exit")
+                || ! strcmp(command->text, "status")
+                || ! strcmp(command->text, "trace")
+                || ! strcmp(command->text, "ulimit")
+                || ! strcmp(command->text, "watch");
+        line->deps = 0;
+        line->dependents = NULL;
+        line->dependentCount = 0;
+        line->pid = -1;
+        line->done = head == NULL;
+        line->result.exit = true;
+        line->result.num = 0;
+        line->result.limit = NULL;
+    }
+    return lines;
+}
+
+/* commandsConflict **********************************************************\
+ * CommandsConflict checks whether two commands must not run at the same
+ *  time, because one writes a file the other reads or writes.  Two commands
+ *  that both append (`>>`, `2>>`, `&>>`) to a file do not conflict, since
+ *  their writes are not lost.  Files are compared by the path as written.
+ * Accepts:
+ *  first (struct argument *): Head of first command
+ *  second (struct argument *): Head of second command
+ * Returns:
+ *  True if the commands touch the same file and one of them writes it.
+ *****************************************************************************/
+bool commandsConflict(struct argument *first, struct argument *second)
+{
+    struct argument *commands[2] = { first, second };
+
+    for (int one = 0; one < 2; one++)
+    {
+        struct argument *writer = commands[one];
+        struct argument *other = commands[1 - one];
+        char *outputs[2] = { writer->redirOutput, writer->redirError };
+        bool appends[2] = { writer->appendOutput, writer->appendError };
+        char *otherOutputs[2] = { other->redirOutput, other->redirError };
+        bool otherAppends[2] = { other->appendOutput, other->appendError };
+
+        for (int i = 0; i < 2; i++)
+        {
+            if (outputs[i] == NULL)
+                continue;
+            if (other->redirInput != NULL
+                    && ! strcmp(outputs[i], other->redirInput))
+                return true;
+            for (int j = 0; j < 2; j++)
+                if (otherOutputs[j] != NULL
+                        && ! strcmp(outputs[i], otherOutputs[j])
+                        && ! (appends[i] && otherAppends[j]))
+                    return true;
+        }
+    }
+    return false;
+}
+
+/* linesConflict *************************************************************\
+ * LinesConflict checks whether two script lines must not run at the same
+ *  time, because some command of one conflicts with some command of the
+ *  other.
  * Accepts:
- *  exitStatus (struct endStatus *): Location of struct endStatus, with
- *      exit/termination information
+ *  first (struct argument *): Head of first line's first command
+ *  second (struct argument *): Head of second line's first command
  * Returns:
- *  Nothing
+ *  True if any pair of their commands conflict.
  *****************************************************************************/
-void printStatus(struct endStatus *exitStatus)
+bool linesConflict(struct argument *first, struct argument *second)
 {
-    if (exitStatus->exit == true)
-        printf("exit value ");
-    else
-        printf("terminated by signal ");
-    printf("%d\n", exitStatus->num);
-    fflush(stdout);
-
-    return;
+    for (struct argument *one = first; one != NULL; one = one->nextCommand)
+        for (struct argument *two = second; two != NULL;
+                two = two->nextCommand)
+            if (commandsConflict(one, two))
+                return true;
+    return false;
 }
-/* changeDir *****************************************************************\
- * ChangeDir changes the working directory.  It defaults to the user's HOME
- *  directory.
+
+/* addDependency *************************************************************\
+ * AddDependency records that one script line must wait for an earlier one.
  * Accepts:
- *  head (struct arguemnt *): Memory location of first word in user input
+ *  lines (struct scriptLine *): Array of script lines
+ *  before (int): Index of line that must finish first
+ *  after (int): Index of line that waits
  * Returns:
  *  Nothing
  *****************************************************************************/
-void changeDir(struct argument *head)
+void addDependency(struct scriptLine *lines, int before, int after)
 {
-    if (head->next == NULL)
-        chdir(getenv("HOME"));
-    else
-        chdir(head->next->text);
+    struct scriptLine *line = &lines[before];
+    line->dependents = realloc(line->dependents,
+            (line->dependentCount + 1) * sizeof(int));
+    line->dependents[line->dependentCount++] = after;
+    lines[after].deps++;
     return;
-
 }
 
-/* killChildren **************************************************************\
- * KillChildren will kill the processes in the linked list of childProcs.
+/* buildDependencies *********************************************************\
+ * BuildDependencies works out which script lines wait on which.  A line waits
+ *  on the most recent barrier line, and on any line since then it conflicts
+ *  with.  A barrier line waits on every line since the previous barrier.
  * Accepts:
- *  head (struct childProc *): Location of first childProc
+ *  lines (struct scriptLine *): Array of script lines
+ *  count (int): Number of script lines
  * Returns:
  *  Nothing
  *****************************************************************************/
-void killChildren(struct childProc *head)
+void buildDependencies(struct scriptLine *lines, int count)
 {
-    struct childProc *old = NULL;
-    int childStatus;
-    while (head != NULL)
+    int lastBarrier = -1;
+
+    for (int i = 0; i < count; i++)
     {
-        old = head;
-        kill(head->id, SIGTERM);
-        waitpid(head->id, &childStatus, 0);
-        head = old->next;
-        free(old);
-    }    
+        if (lines[i].head == NULL)
+            continue;
+        if (lastBarrier != -1)
+            addDependency(lines, lastBarrier, i);
+        for (int j = lastBarrier + 1; j < i; j++)
+        {
+            if (lines[j].head == NULL)
+                continue;
+            if (lines[i].barrier
+                    || linesConflict(lines[j].head, lines[i].head))
+                addDependency(lines, j, i);
+        }
+        if (lines[i].barrier)
+            lastBarrier = i;
+    }
     return;
 }
 
-/* builtIn *******************************************************************\
- * builtIn looks at input words and checks to see the command was a
- *  comment or one of the three built-in commands: `cd, `exit`, and `status`.
+/* finishLine ****************************************************************\
+ * FinishLine marks a script line as done, and releases the lines waiting on
+ *  it.
  * Accepts:
- *  head (struct argument *): Memory location of first word in user input
- *  children (struct childProc *): Location of first childProc
- *  exitStatus (struct endStatus *): Location of struct endStatus, for use
- *      by `status` command.
+ *  lines (struct scriptLine *): Array of script lines
+ *  index (int): Index of line that finished
  * Returns:
- *  True if the command was a built-in.  False, otherwise.
+ *  Nothing
  *****************************************************************************/
-bool builtIn(struct argument *head, struct childProc *children, 
-        struct endStatus *exitStatus)
+void finishLine(struct scriptLine *lines, int index)
 {
-    if (! strcmp("exit", head->text))
-    {
-        killChildren(children);
-        freeArguments(head);
-        free(exitStatus);
-        exit(EXIT_SUCCESS);
-        return true;
-    }
-    if (! strcmp("cd", head->text))
-    {
-        changeDir(head);
-        return true;
-    }
-    if (! strcmp("status", head->text))
-    {
-        printStatus(exitStatus);
-        return true;
-    }
-
-    return false;
+    lines[index].done = true;
+    lines[index].pid = -1;
+    for (int i = 0; i < lines[index].dependentCount; i++)
+        lines[lines[index].dependents[i]].deps--;
+    return;
 }
 
-/* makeArgument **************************************************************\
- * MakeArgument takes a word (space-separated part of user input), and creates
- *  an `argument` struct.  This allows for a linked list of words for program
- *  use.
+/* freeScript ****************************************************************\
+ * FreeScript removes the memory allocations for the script lines.
  * Accepts:
- *  token (char *): Memory location of word
+ *  lines (struct scriptLine *): Array of script lines
+ *  count (int): Number of script lines
  * Returns:
- *  struct argument *: Memoory location of argument struct
+ *  Nothing
  *****************************************************************************/
-struct argument *makeArgument(char *token)
+void freeScript(struct scriptLine *lines, int count)
 {
-    struct argument *thisWord = malloc(sizeof(struct argument));
-
-    thisWord->text = calloc(strlen(token) + 1, sizeof(char));
-    strcpy(thisWord->text, token);
-    thisWord->redirInput = NULL;
-    thisWord->redirOutput = NULL;
-    thisWord->background = false;
-    thisWord->position = -1;
-    thisWord->next = NULL;
-    
-    return thisWord;
+    for (int i = 0; i < count; i++)
+    {
+        freeArguments(lines[i].head);
+        free(lines[i].dependents);
+    }
+    free(lines);
+    return;
 }
 
-/* separateInput *************************************************************\
- * SeparateInput takes the line of user input and separates it into a linked
- *  list of char * tokens, separated by space.
+/* runScriptParallel *********************************************************\
+ * RunScriptParallel runs a script in parallel (`-P`) mode.  Lines whose
+ *  redirections do not conflict run at the same time, up to one per core.
+ *  `wait` and the built-in commands are barriers: they run in the shell once
+ *  everything before them is done, along with the rest of their list.
+ *  Other lists run in a subshell.  Each line's status is printed in script
+ *  order, except for a lone `wait` or `status`.
  * Accepts:
- *  input (char *): Pointer to user input
+ *  path (char *): Filepath of script
+ *  processID (pid_t): ProcessID of current process
+ *  exitStatus (struct endStatus *): Location of struct endStatus, for use
+ *      by `status` command.
+ *  SIGINT_action (struct sigaction): Struct for handling SIGINT
+ *  SIGTSTP_action (struct sigaction): Struct for handling SIGTSTP
  * Returns:
- *  Head of linked list of struct arguments
+ *  Integer: 0 if every line succeeded and 1 if any line failed
  *****************************************************************************/
-struct argument *separateInput(char *input)
+int runScriptParallel(char *path, pid_t processID,
+        struct endStatus *exitStatus, struct sigaction SIGINT_action,
+        struct sigaction SIGTSTP_action)
 {
-    struct argument *head = NULL;
-    struct argument *tail = NULL;
-    int counter = 0;
-    char *saveptr;
-    char *token = strtok_r(input, " ", &saveptr);
-    
-    while (token != NULL)
+    FILE *stream = fopen(path, "r");
+    if (stream == NULL)
     {
-        struct argument *thisWord = makeArgument(token);
-        if (head == NULL)
+        perror(path);
+        return EXIT_FAILURE;
+    }
+    int count;
+    struct scriptLine *lines = readScript(stream, processID, &count);
+    fclose(stream);
+    buildDependencies(lines, count);
+
+    long workers = sysconf(_SC_NPROCESSORS_ONLN);
+    if (workers < 1)
+        workers = 1;
+    int running = 0;                    // lines with a process running
+    int reported = 0;                   // lines before this are reported
+    bool failed = false;                // whether any line failed
+    int childStatus;
+    struct rusage usage;
+
+    while (true)
+    {
+        // Report finished lines, in script order
+        while (reported < count && lines[reported].done)
         {
-            head = thisWord;
-            tail = thisWord;
+            struct scriptLine *line = &lines[reported++];
+            if (line->head == NULL)
+                continue;
+            if (! line->result.exit || line->result.num != 0)
+                failed = true;
+            // a lone `wait` or `status` has nothing of its own to report
+            if (line->head->nextCommand == NULL
+                    && (! strcmp(line->head->text, "wait")
+                        || ! strcmp(line->head->text, "status")))
+                continue;
+            *exitStatus = line->result;
+            printf("line %d: ", line->number);
+            printStatus(exitStatus);
         }
-        else
+        if (reported == count)
+            break;
+
+        // Start lines that are no longer waiting, while workers are free
+        for (int i = reported; i < count; i++)
         {
-            tail->next = thisWord;
-            tail = thisWord;
+            struct scriptLine *line = &lines[i];
+            if (line->done || line->pid != -1 || line->deps > 0)
+                continue;
+            if (line->barrier)
+            {
+                // everything before a ready barrier is done and reported
+                if (! strcmp(line->head->text, "exit"))
+                {
+                    traceStop();
+                    freeScript(lines, count);
+                    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+                }
+                freeChildren(runList(line->head, NULL, exitStatus,
+                            &line->result, SIGINT_action, SIGTSTP_action));
+                finishLine(lines, i);
+                break;
+            }
+            if (running == workers)
+                break;
+            line->start = traceTime();
+            if (line->head->nextCommand != NULL)
+                line->pid = spawnList(line->head, SIGINT_action,
+                        SIGTSTP_action);
+            else
+                line->pid = spawnProcess(line->head, SIGINT_action,
+                        SIGTSTP_action);
+            // a redirection that could not be opened fails the line
+            if (line->pid == -1)
+            {
+                line->result.num = 1;
+                finishLine(lines, i);
+                continue;
+            }
+            running++;
+        }
+        if (running == 0)
+            continue;
+
+        // Wait for any line to finish
+        pid_t doneID = wait4(-1, &childStatus, 0, &usage);
+        if (doneID == -1)
+            continue;
+        for (int i = reported; i < count; i++)
+        {
+            if (lines[i].pid == doneID)
+            {
+                traceEvent("run", doneID, lines[i].number, lines[i].start,
+                        traceTime());
+                setEndStatus(&lines[i].result, childStatus, &usage,
+                        lines[i].head);
+                finishLine(lines, i);
+                running--;
+                break;
+            }
         }
-        thisWord->position = counter++;
-        token = strtok_r(NULL, " ", &saveptr);
     }
-    // Check for background task
-    if ( ! strcmp(tail->text, "&"))
-            setBackground(head);
 
-    return head;
+    traceStop();
+    freeScript(lines, count);
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
 }
- 
-/* check$$ *******************************************************************\
- * Check$$ looks for an instance of `$$` in the input, for variable expansion.
- *  This should only be triggered after encountering the first instance of `$`.
+
+/* benchCase *****************************************************************\
+ * BenchCase parses one line over and over for a fixed time, and prints how
+ *  many lines and bytes per second `parseLine` got through.
  * Accepts:
- *  input (char *): Memory location of user input
- *  i: Current index within the input
- *  processID: Current PID
+ *  name (char *): Name of the case, for the report
+ *  line (char *): Line to parse
  * Returns:
- *  New index within the input (int)
+ *  Nothing
  *****************************************************************************/
-int check$$(char *input, int i, pid_t processID)
+void benchCase(char *name, char *line)
 {
-    char c;
-
-    // if next character is also `$`, we replace with pid
-    if ((c = getchar()) == '$')
-    {
-        input = input + sizeof(char) *i;
-        sprintf(input, "%d", processID);
-        i += floor(log10(processID)+1);
-    }
+    long long count = 0;
+    size_t length = strlen(line);
+    long long start = traceTime();
+    long long elapsed = 0;
 
-    // if next character was not also `$`, we don't replace, but we might
-    //  be done with line
-    else
+    while (elapsed < BENCH_TIME)
     {
-        input[i++] = '$';
-        // if next character was newline, we terminate string, otherwise append 
-        //  next character
-        if (c == '\n')
-            input[i] = '\0';
-        else
-            input[i++] = c;
+        // check the clock only now and then, so it does not skew the result
+        for (int i = 0; i < 64; i++)
+            freeArguments(parseLine(line, 123456));
+        count += 64;
+        elapsed = traceTime() - start;
     }
-    return i;
+    double seconds = elapsed / 1000000.0;
+    printf("%-20s %12.0f lines/s %10.1f MB/s\n", name, count / seconds,
+            count * length / seconds / 1000000);
+    fflush(stdout);
+    return;
 }
 
-/* getInput ******************************************************************\
- * GetInput solicits input from the user, and places it within a linked list of
- *  `argument` structs.
+/* benchParse ****************************************************************\
+ * BenchParse runs the parser microbenchmark (`--bench-parse`), over both
+ *  ordinary lines and lines built to hit the parser's limits.  Error messages
+ *  from the parser are thrown away while it runs.
  * Accepts:
- *  processID (pid_t): ProcessID of current process
- * Returns:
  *  Nothing
+ * Returns:
+ *  Integer: 0 for successful execution and 1 for unsuccessful execution
  *****************************************************************************/
-struct argument  *getInput(pid_t processID)
+int benchParse(void)
 {
-    char input[LINE_LENGTH];            // user input
-    char c;                             // each character in input
-    int i = 0;                          // location within input
-    struct argument *head = NULL;       // head of linked list for input
-
-    // Get user input
-    printf(": ");
-    fflush(stdout);
-    while ((c = getchar()) != '\n')
+    char line[LINE_LENGTH];
+    int savedError = dup(STDERR_FILENO);
+    int devNull = open("/dev/null", O_WRONLY);
+    if (savedError == -1 || devNull == -1)
     {
-        // if we got a `$`, check for $$ replacement
-        if (c == '$')
-        {
-            i = check$$(input, i, processID);
-            // check to make sure we didn't terminate string in `check$$`
-            if (input[i] == '\0')
-                break;
-        }
-        // if we didn't get a `$`, append character to input
-        else
-            input[i++] = c;
+        perror("bench-parse");
+        return EXIT_FAILURE;
     }
-    input[i] = '\0';                    // make last character a terminator
-    // if input was empty or comment, we return empty linked list 
-    if (i == 0 || input[0] == '#')
-        return head;
-    // We now know input is neither empty nor commment, so we separate input
-    //  into words
-    head = separateInput(input);
-
-    return head;
+    dup2(devNull, STDERR_FILENO);
+    close(devNull);
+
+    benchCase("simple", "ls -la /tmp");
+    benchCase("redirects", "sort -k 2 < input.txt > output.txt &");
+    benchCase("pid", "echo $$ > file$$.txt");
+    benchCase("limit", "limit cpu=2 mem=64M ./worker --quiet");
+    benchCase("list", "make > build.log && ./test || echo failed ; status");
+
+    // one word after another, up to the longest line read
+    line[0] = '\0';
+    while (strlen(line) + 9 < LINE_LENGTH - 1)
+        strcat(line, "abcdefgh ");
+    benchCase("long line", line);
+
+    // `$$` with room for the pid, and with too little room
+    line[0] = '\0';
+    for (int i = 0; i < 200; i++)
+        strcat(line, "$$ ");
+    benchCase("many $$", line);
+    line[0] = '\0';
+    for (int i = 0; i < LINE_LENGTH / 2 - 1; i++)
+        strcat(line, "$$");
+    benchCase("overflowing $$", line);
+
+    // as many words as `execvp` can take, and one more
+    line[0] = '\0';
+    for (int i = 0; i < MAX_ARGUMENTS - 1; i++)
+        strcat(line, "a ");
+    benchCase("max arguments", line);
+    strcat(line, "a");
+    benchCase("too many arguments", line);
+
+    dup2(savedError, STDERR_FILENO);
+    close(savedError);
+    return EXIT_SUCCESS;
 }
 
-/* checkTerminatedChildren ***************************************************\
- * CheckTerminatedChildren goes through the linked list of children processes,
- *  printing an appropriate termination message and cleaning up the linked list
- *  when it finds one.
+#ifdef SMALLSH_FUZZ
+/* LLVMFuzzerTestOneInput ****************************************************\
+ * LLVMFuzzerTestOneInput is the entry point for fuzzing the parser with
+ *  libFuzzer or AFL++.  Each input is treated as one line, cut at the first
+ *  newline and at LINE_LENGTH, as `readLine` would.
  * Accepts:
- *  head (struct childProc *): Location of first childProc
- *  sig (bool): Whether or not this function was called by signal termination
+ *  data (const unsigned char *): Fuzzer input
+ *  size (size_t): Length of fuzzer input
  * Returns:
- *  head of linked list of childProcs 
+ *  Integer: always 0
  *****************************************************************************/
-struct childProc *checkTerminatedChildren(struct childProc *head, bool sig)
+int LLVMFuzzerTestOneInput(const unsigned char *data, size_t size)
 {
-    // if there are no child processes, return
-    if (head == NULL)
-        return head;
+    char line[LINE_LENGTH];
+    size_t length = 0;
 
-    // if there are child processes, we iterate and look to see if anyone has
-    //  exited
-    struct childProc *current = head;
-    int childStatus;
-    int waitStatus;
-    while (current != NULL)
+    while (length < size && length < LINE_LENGTH - 1 && data[length] != '\n'
+            && data[length] != '\0')
     {
-        waitStatus = waitpid(current->id,&childStatus, WNOHANG);
-        if (waitStatus != 0)
-        {
-            // child process has terminated
-            if (WIFEXITED(childStatus))
-                printf("background pid %d is done: exit value %d\n", 
-                        waitStatus, WEXITSTATUS(childStatus));
-            else if (sig)
-                printf("terminated by signal %d\n", WTERMSIG(childStatus));
-            else
-                printf("background pid %d is done: terminated by signal %d\n",
-                        waitStatus, WTERMSIG(childStatus));
-            fflush(stdout);
-            current = current->next;
-            head = removeChildProc(head, waitStatus);
-        }
-        else
-            current = current->next;
+        line[length] = data[length];
+        length++;
     }
-
-    return head;
+    line[length] = '\0';
+    freeArguments(parseLine(line, 123456));
+    return 0;
 }
-
-/* checkForegroundOnly *******************************************************\
- * CheckForegroundOnly checks to see if Foreground Only status has changed
- *  since last run.
+#else
+/* main **********************************************************************\
+ * Main runs the limited shell program.  With `-P <script>`, it runs the
+ *  script in parallel mode instead of reading commands from stdin.  With
+ *  `--trace <file>`, it starts with tracing on.  With `--grace <ms>`, it sets
+ *  how long `exit` waits for background processes before using SIGKILL.  With
+ *  `--spawn-helper`, commands are started by the spawn helper.  With
+ *  `--bench-parse`, it runs the parser microbenchmark and leaves.
  * Accepts:
- *  Nothing
+ *  argc (int): Number of command-line arguments
+ *  argv (char *[]): Command-line arguments
  * Returns:
- *  True if now in foreground only mode, false if not.
+ *  Integer: 0 for successful execution and 1 for unsuccessful execution
  *****************************************************************************/
-bool checkForegroundOnly(bool lastTime)
+int main(int argc, char *argv[])
+
 {
-    if (lastTime != backgroundOnly)
+    char *parallelScript = NULL;            // script for `-P` mode
+    bool useHelper = false;                 // whether to use spawn helper
+    bool end = false;                       // whether input has run out
+    struct endStatus result;                // how the last list ended
+
+    // Read command-line options
+    for (int i = 1; i < argc; i++)
     {
-        if (lastTime == false)
+        if (! strcmp(argv[i], "-P") && i + 1 < argc)
+            parallelScript = argv[++i];
+        else if (! strcmp(argv[i], "--trace") && i + 1 < argc)
         {
-            printf("Entering foreground-only mode (& is now ignored)\n");
-            return true;
+            if (! traceStart(argv[++i]))
+                return EXIT_FAILURE;
         }
+        else if (! strcmp(argv[i], "--grace") && i + 1 < argc)
+            killGrace = atoi(argv[++i]);
+        else if (! strcmp(argv[i], "--bench-parse"))
+            return benchParse();
+        else if (! strcmp(argv[i], "--spawn-helper"))
+            useHelper = true;
         else
         {
-            printf("Exiting foreground-only mode\n");
-            return false;
+            fprintf(stderr, "usage: %s [--trace file] [--grace ms] "
+                    "[--spawn-helper] [--bench-parse] [-P script]\n", argv[0]);
+            return EXIT_FAILURE;
         }
     }
-    return lastTime;
-}
 
-/* main **********************************************************************\
- * Main runs the limited shell program.
- * Accepts:
- *  Nothing
- * Returns:
- *  Integer: 0 for successful execution and 1 for unsuccessful execution
- *****************************************************************************/
-int main(void)
+    // Start the spawn helper while the shell is still small
+    if (useHelper)
+        startSpawnHelper();
 
-{
     pid_t processID = getpid();             // smallsh pid
     struct childProc *children = NULL;      // children processes linked list
     struct endStatus *exitStatus = malloc(sizeof(struct endStatus));
     exitStatus->exit = true;
     exitStatus->num = 0;
+    exitStatus->limit = NULL;
 
     //Set up SIGINT handling, following example at from Canvas page.
     struct sigaction SIGINT_action;
@@ -868,6 +3936,19 @@ int main(void)
     SIGTSTP_action.sa_flags = SA_RESTART;
     sigaction(SIGTSTP, &SIGTSTP_action, NULL);
 
+    if (parallelScript != NULL)
+    {
+        int result = runScriptParallel(parallelScript, processID, exitStatus,
+                SIGINT_action, SIGTSTP_action);
+        free(exitStatus);
+        return result;
+    }
+
+    // Index the commands on PATH now, so the first Tab is as quick as later
+    //  ones
+    if (isatty(STDIN_FILENO))
+        indexPath();
+
     while(true)
     {
         // create input struct
@@ -876,30 +3957,26 @@ int main(void)
         // Check for any terminated children processes
         children = checkTerminatedChildren(children, false);
         // Get input
-        head = getInput(processID);
-        // Check against blank lines and comments 
-        if (head == NULL)
-        {
-            continue;
-        }
-        // Check against built-in functions: cd, exit, status
-        else if (builtIn(head, children, exitStatus))
+        head = getInput(stdin, processID, &end);
+        // Leave at end of input, and check against blank lines and comments
+        if (end)
+            break;
+        else if (head == NULL)
         {
             continue;
         }
-        // Run fork and execute other processes
-        else
-        {
-            children = otherProcess(head, children, exitStatus, SIGINT_action,
-                    SIGTSTP_action);
-        }
+        // Run the line's list of commands
+        children = runList(head, children, exitStatus, &result,
+                SIGINT_action, SIGTSTP_action);
 
         freeArguments(head);
     }
 
-    // No idea how you would get here.  But let's free memory and leave anyway.
-     freeChildren(children);
-     free(exitStatus);
+    // Input ran out, so we leave as if `exit` had been entered
+    killChildren(children);
+    traceStop();
+    free(exitStatus);
 
     return EXIT_SUCCESS;
 }
+#endif